@@ -1,16 +1,38 @@
 // GR5260.cpp - test program
 #include <cassert>
+#include <cstddef>
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <filesystem>
+#include <fstream>
 #include <functional>
+#include <memory>
+#include <new>
 #include <random>
+#include <sstream>
+#include <thread>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include "fms_adjoint.h"
 #include "fms_analytic.h"
+#include "fms_jet.h"
 #include "fms_black.h"
 #include "fms_brownian.h"
 #include "fms_njr.h"
 #include "fms_poly.h"
 #include "fms_root1d_newton.h"
 #include "fms_bootstrap.h"
+#include "fms_pwflat_cached.h"
+#include "fms_pwflat_bundle.h"
+#include "fms_pwflat_static.h"
+#include "fms_pwflat_portfolio.h"
+#include "fms_pwflat_parallel.h"
+#include "fms_pwflat_swap.h"
+#include "fms_fixed_income_ladder.h"
+#include "fms_binary.h"
+#include "fms_quote.h"
 #include "fms_fixed_income.h"
 #include "fms_ho_lee.h"
 #include "fms_swaption.h"
@@ -29,6 +51,138 @@ inline auto timer(const std::function<void(void)>& f, size_t count = 1)
     return elapsed.count(); // duration in seconds
 }
 
+// number of calls to operator new
+static std::atomic<size_t> allocations = 0;
+
+// Every replaceable form, including nothrow and aligned, is replaced so allocation and
+// deallocation functions match.
+// They are not inlined so the compiler does not see malloc and free paired with new and delete.
+#ifdef _MSC_VER
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+NOINLINE void* operator new(size_t n)
+{
+    ++allocations;
+    if (void* p = malloc(n ? n : 1)) {
+        return p;
+    }
+
+    throw std::bad_alloc{};
+}
+NOINLINE void* operator new[](size_t n)
+{
+    return operator new(n);
+}
+NOINLINE void* operator new(size_t n, std::align_val_t a)
+{
+    ++allocations;
+    size_t a_ = static_cast<size_t>(a);
+    size_t n_ = n ? (n + a_ - 1)/a_*a_ : a_; // aligned_alloc needs a multiple of the alignment
+#ifdef _WIN32
+    if (void* p = _aligned_malloc(n_, a_)) {
+#else
+    if (void* p = aligned_alloc(a_, n_)) {
+#endif
+        return p;
+    }
+
+    throw std::bad_alloc{};
+}
+NOINLINE void* operator new[](size_t n, std::align_val_t a)
+{
+    return operator new(n, a);
+}
+NOINLINE void* operator new(size_t n, const std::nothrow_t&) noexcept
+{
+    try {
+        return operator new(n);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+NOINLINE void* operator new[](size_t n, const std::nothrow_t&) noexcept
+{
+    try {
+        return operator new[](n);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+NOINLINE void* operator new(size_t n, std::align_val_t a, const std::nothrow_t&) noexcept
+{
+    try {
+        return operator new(n, a);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+NOINLINE void* operator new[](size_t n, std::align_val_t a, const std::nothrow_t&) noexcept
+{
+    try {
+        return operator new[](n, a);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+NOINLINE void operator delete(void* p) noexcept
+{
+    free(p);
+}
+NOINLINE void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+NOINLINE void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+NOINLINE void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+NOINLINE void operator delete(void* p, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+NOINLINE void operator delete(void* p, size_t, std::align_val_t a) noexcept
+{
+    operator delete(p, a);
+}
+NOINLINE void operator delete[](void* p, std::align_val_t a) noexcept
+{
+    operator delete(p, a);
+}
+NOINLINE void operator delete[](void* p, size_t, std::align_val_t a) noexcept
+{
+    operator delete(p, a);
+}
+NOINLINE void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    operator delete(p);
+}
+NOINLINE void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    operator delete[](p);
+}
+NOINLINE void operator delete(void* p, std::align_val_t a, const std::nothrow_t&) noexcept
+{
+    operator delete(p, a);
+}
+NOINLINE void operator delete[](void* p, std::align_val_t a, const std::nothrow_t&) noexcept
+{
+    operator delete[](p, a);
+}
+
 // [f() + ... f()]/n
 template<class X>
 inline X mean(const std::function<X()>& f, size_t n)
@@ -118,6 +272,75 @@ void test_fms_poly_Bell()
     secs = secs;
 }
 
+template<class X>
+void test_fms_prob_normal()
+{
+    using fms::prob::accuracy;
+    X sqrt2 = sqrt(X(2));
+    auto cdf_erf = [sqrt2](X x) { return X(0.5) + erf(x/sqrt2)/2; };
+
+    size_t n = 10001;
+    std::vector<X> x(n), y(n), z(n);
+    for (size_t i = 0; i < n; ++i) {
+        x[i] = -10 + X(20)*i/(n - 1);
+    }
+
+    // maximum absolute error against erf
+    auto err = [&](auto cdf) {
+        X e = 0;
+        for (size_t i = 0; i < n; ++i) {
+            e = std::max(e, X(fabs(cdf(x[i]) - cdf_erf(x[i]))));
+        }
+        return e;
+    };
+    X eps = std::numeric_limits<X>::epsilon();
+    ensure (err(fms::prob::normal_cdf<X,accuracy::low>) <= 7.5e-8 + 2*eps);
+    ensure (err(fms::prob::normal_cdf<X,accuracy::medium>) <= std::max(X(1e-12), 2*eps));
+    ensure (err(fms::prob::normal_cdf<X,accuracy::full>) <= 2*eps);
+
+    // tails are small, not 0
+    ensure (fms::prob::normal_cdf(X(-8)) > 0);
+    ensure (fabs(fms::prob::normal_cdf(X(-8))/(erfc(8/sqrt2)/2) - 1) <= 64*eps);
+    ensure (fms::prob::normal_cdf(-std::numeric_limits<X>::infinity()) == 0);
+    ensure (fms::prob::normal_cdf(std::numeric_limits<X>::infinity()) == 1);
+    ensure (std::isnan(fms::prob::normal_cdf(std::numeric_limits<X>::quiet_NaN())));
+    ensure (fabs(fms::prob::normal_pdf(X(1)) - exp(X(-0.5))/sqrt(2*X(M_PI))) <= eps);
+
+    // array kernels match scalar or have the same accuracy
+    fms::simd::normal_cdf<accuracy::low>(n, x.data(), y.data());
+    for (size_t i = 0; i < n; ++i) {
+        ensure (fabs(y[i] - fms::prob::normal_cdf<X,accuracy::low>(x[i])) <= 2*eps);
+    }
+    fms::simd::normal_cdf<accuracy::medium>(n, x.data(), y.data());
+    for (size_t i = 0; i < n; ++i) {
+        ensure (fabs(y[i] - cdf_erf(x[i])) <= std::max(X(1e-12), 2*eps));
+    }
+    fms::simd::normal_cdf(n, x.data(), y.data());
+    fms::simd::normal_pdf(n, x.data(), z.data());
+    for (size_t i = 0; i < n; ++i) {
+        ensure (fabs(y[i] - fms::prob::normal_cdf(x[i])) <= 2*eps);
+        ensure (fabs(z[i] - fms::prob::normal_pdf(x[i])) <= 2*eps);
+    }
+
+    double secs;
+    X s = 0;
+    secs = timer([&]() { for (auto xi : x) s += cdf_erf(xi); }, 100);
+    secs = secs;
+    secs = timer([&]() { for (auto xi : x) s += fms::prob::normal_cdf<X,accuracy::low>(xi); }, 100);
+    secs = secs;
+    secs = timer([&]() { for (auto xi : x) s += fms::prob::normal_cdf<X,accuracy::medium>(xi); }, 100);
+    secs = secs;
+    secs = timer([&]() { for (auto xi : x) s += fms::prob::normal_cdf<X,accuracy::full>(xi); }, 100);
+    secs = secs;
+    secs = timer([&]() { fms::simd::normal_cdf<accuracy::low>(n, x.data(), y.data()); }, 100);
+    secs = secs;
+    secs = timer([&]() { fms::simd::normal_cdf<accuracy::medium>(n, x.data(), y.data()); }, 100);
+    secs = secs;
+    secs = timer([&]() { fms::simd::normal_cdf<accuracy::full>(n, x.data(), y.data()); }, 100);
+    secs = secs;
+    s = s;
+}
+
 template<class X>
 void test_fms_prob_njr()
 {
@@ -163,6 +386,16 @@ void test_fms_root1d_newton()
         thrown = true;
     }
     assert(thrown);
+
+    // a bracket keeps rounding noise near the root, e.g., from fused multiply-add,
+    // from exhausting the iterations
+    X h = 64*std::numeric_limits<X>::epsilon()*a;
+    std::function<X(X)> g = [a, h](X x) { return x * x - a + h*sin(x*X(1e15)); };
+    x = root1d::newton_solver<X,X>(X(x0), g, df, X(2), X(3)).solve();
+    ensure (fabs(x * x - a) <= 4*h);
+    // steps leaving the bracket bisect
+    x = root1d::newton_solver<X,X>(X(3), f, df, X(2), X(3)).solve();
+    ensure (fabs(x * x - a) <= 4*std::numeric_limits<X>::epsilon()*a);
 }
 
 template<class X>
@@ -224,6 +457,35 @@ void test_fms_black_vega()
     assert(fabs(dv - dv0) < n*eps);
 }
 
+// zero volatility and time, and vega away from the money
+template<class X>
+void test_fms_black_edge()
+{
+    X f = X(100);
+
+    // intrinsic value, including volatility below machine epsilon
+    for (X s : {X(0), X(1e-20)}) {
+        ensure (black::value(f, s, X(90)) == 0);
+        ensure (black::value(f, s, X(110)) == 10);
+        ensure (black::value(f, s, f) == 0);
+        ensure (black::delta(f, s, X(90)) == 0);
+        ensure (black::delta(f, s, X(110)) == -1);
+        ensure (black::delta(f, s, f) == X(-0.5));
+    }
+    ensure (black::value(f, X(0.2), X(110), X(0)) == 10);
+    ensure (black::vega(f, X(0.2), X(110), X(0)) == 0);
+    ensure (black::vega(f, X(0.2), f, X(0)) == 0);
+
+    // k phi(z) = f phi(z - s) so vega is not f phi(z) sqrt(t)
+    X h = cbrt(std::numeric_limits<X>::epsilon());
+    for (X k : {X(80), X(100), X(125)}) {
+        X sigma = X(0.2), t = X(0.25);
+        X dv = (black::value(f, sigma + h, k, t) - black::value(f, sigma - h, k, t))/(2*h);
+        X v = black::vega(f, sigma, k, t);
+        ensure (fabs(v - dv) <= 1000*h*h*(1 + fabs(dv)));
+    }
+}
+
 // multiple of machine epsilon
 template<class X>
 struct implied {
@@ -255,6 +517,260 @@ void test_fms_black_implied()
         X eps_ = s - sigmai;
         assert(fabs(eps_) <= implied<X>::n*eps);
     }
+
+    // chain from deep in to deep out of the money
+    std::vector<X> f_, v_, k_, t_, sigma_;
+    for (X ti : {X(1)/365, X(1)/12, X(1), X(10)}) {
+        for (X ki = X(10); ki <= X(1000); ki *= X(1.1)) {
+            for (X si : {X(0.01), X(0.1), X(0.3), X(1), X(3)}) {
+                f_.push_back(f);
+                k_.push_back(ki);
+                t_.push_back(ti);
+                v_.push_back(black::value(f, si, ki, ti));
+                sigma_.push_back(si);
+            }
+        }
+    }
+    size_t n = f_.size(), it, max_it = 0;
+    std::vector<X> s_(n);
+    black::implied(n, f_.data(), v_.data(), k_.data(), t_.data(), s_.data());
+    for (size_t i = 0; i < n; ++i) {
+        X tv = v_[i] - std::max(k_[i] - f_[i], X(0)); // time value
+        if (!(tv > 0 && v_[i] < k_[i])) {
+            continue;
+        }
+        ensure (s_[i] == black::implied(f_[i], v_[i], k_[i], t_[i], &it));
+        max_it = std::max(max_it, it);
+        // reproduces the value and the volatility up to rounding of the value
+        X v = black::value(f_[i], s_[i], k_[i], t_[i]);
+        ensure (fabs(v - v_[i]) <= 16*eps*k_[i]);
+        ensure (fabs(s_[i] - sigma_[i])*black::vega(f_[i], sigma_[i], k_[i], t_[i]) <= 16*eps*k_[i]);
+    }
+    ensure (max_it <= 4);
+
+    // no arbitrage bounds
+    ensure (black::implied(f, X(5), X(105), t) == 0);
+    X k0 = 105, v0 = 4;
+    black::implied(1, &f, &v0, &k0, &t, s_.data());
+    ensure (std::isnan(s_[0]));
+    bool thrown = false;
+    try {
+        black::implied(f, v0, k0, t);
+    }
+    catch (...) {
+        thrown = true;
+    }
+    ensure (thrown);
+
+    // bad inputs give NaN instead of throwing
+    X nan = std::numeric_limits<X>::quiet_NaN();
+    X f1[] = { 0, -f, nan, f, f, f, f, f };
+    X k1[] = { k, k, k, 0, nan, k, k, k };
+    X t1[] = { t, t, t, t, t, 0, -t, nan };
+    X v1[] = { 5, 5, 5, 5, 5, 5, 5, 5 };
+    black::implied(8, f1, v1, k1, t1, s_.data());
+    for (size_t i = 0; i < 8; ++i) {
+        ensure (std::isnan(s_[i]));
+    }
+    // values just under k can round onto the upper bound when normalized
+    for (X ki = f + X(0.5); ki < 10*f; ki *= X(1.01)) {
+        X vi = std::nextafter(ki, X(0));
+        black::implied(1, &f, &vi, &ki, &t, s_.data());
+        ensure (std::isnan(s_[0]) || s_[0] > 0);
+    }
+
+    double secs;
+    secs = timer([&]() { black::implied(n, f_.data(), v_.data(), k_.data(), t_.data(), s_.data()); }, 10);
+    secs = secs;
+}
+
+template<class X>
+void test_fms_black_batch()
+{
+    // chain of strikes and expiries including edge cases
+    std::vector<X> f, sigma, k, t;
+    for (X t_ : {X(0), X(1)/52, X(0.25), X(0.5), X(1), X(2), X(5)}) {
+        for (X k_ = 0; k_ <= 200; k_ += X(2.5)) {
+            for (X sigma_ : {X(0), X(0.05), X(0.2), X(1)}) {
+                f.push_back(X(100));
+                sigma.push_back(sigma_);
+                k.push_back(k_);
+                t.push_back(t_);
+            }
+        }
+    }
+    f[1] = 0;
+    size_t n = f.size();
+
+    // relative to the size of the terms, e.g., f N(d1) - k N(d2) for values
+    X eps = std::numeric_limits<X>::epsilon();
+    auto close = [eps](X a, X b, X scale) {
+        return fabs(a - b) <= 64*eps*scale;
+    };
+
+    std::vector<X> v(n), d(n), g(n);
+    black::value(n, f.data(), sigma.data(), k.data(), t.data(), v.data());
+    black::delta(n, f.data(), sigma.data(), k.data(), t.data(), d.data());
+    black::vega(n, f.data(), sigma.data(), k.data(), t.data(), g.data());
+    for (size_t i = 0; i < n; ++i) {
+        X v_ = black::value(f[i], sigma[i], k[i], t[i]);
+        X d_ = black::delta(f[i], sigma[i], k[i], t[i]);
+        X g_ = black::vega(f[i], sigma[i], k[i], t[i]);
+        ensure (close(v[i], v_, f[i] + k[i]));
+        ensure (close(d[i], d_, 1));
+        ensure ((std::isnan(g[i]) && std::isnan(g_)) || close(g[i], g_, 1 + fabs(g_)));
+    }
+
+    std::vector<X> r(n, X(0.03)), bv(n), bd(n);
+    fms::bsm::value(n, r.data(), f.data(), sigma.data(), k.data(), t.data(), bv.data());
+    fms::bsm::delta(n, r.data(), f.data(), sigma.data(), k.data(), t.data(), bd.data());
+    for (size_t i = 0; i < n; ++i) {
+        ensure (close(bv[i], fms::bsm::value(r[i], f[i], sigma[i], k[i], t[i]), f[i] + k[i]));
+        ensure (close(bd[i], fms::bsm::delta(r[i], f[i], sigma[i], k[i], t[i]), 1));
+    }
+
+    // negative values throw like the scalar functions
+    bool thrown = false;
+    try {
+        X k_ = -1;
+        black::value(1, f.data(), sigma.data() + 2, &k_, t.data(), v.data());
+    }
+    catch (...) {
+        thrown = true;
+    }
+    ensure (thrown);
+
+    // 400 strikes by 40 expiries
+    f.clear(); sigma.clear(); k.clear(); t.clear();
+    for (size_t j = 1; j <= 40; ++j) {
+        for (size_t i = 1; i <= 400; ++i) {
+            f.push_back(X(100));
+            sigma.push_back(X(0.2) + X(i)/4000);
+            k.push_back(X(i)/2);
+            t.push_back(X(j)/8);
+        }
+    }
+    n = f.size();
+    v.resize(n);
+
+    double secs, options;
+    secs = timer([&]() {
+        for (size_t i = 0; i < n; ++i) {
+            v[i] = black::value(f[i], sigma[i], k[i], t[i]);
+        }
+    }, 10);
+    options = 10*n/secs;
+    options = options;
+    secs = timer([&]() {
+        black::value(n, f.data(), sigma.data(), k.data(), t.data(), v.data());
+    }, 10);
+    options = 10*n/secs;
+    options = options;
+}
+
+template<class X>
+void test_fms_black_greeks()
+{
+    X eps = std::numeric_limits<X>::epsilon();
+    X h = cbrt(eps);
+    X tol = 1000*h*h; // central differences
+    X f = 100, r = X(0.05);
+
+    for (X k : {X(50), X(90), X(100), X(110), X(200)}) {
+        for (X sigma : {X(0.1), X(0.4)}) {
+            for (X t : {X(0.1), X(1), X(4)}) {
+                auto g = black::risk(f, sigma, k, t, true);
+                ensure (fabs(g.value - black::value(f, sigma, k, t)) <= 4*eps*k);
+                ensure (g.delta == black::delta(f, sigma, k, t));
+                ensure (fabs(g.vega - black::vega(f, sigma, k, t)) <= 4*eps*g.vega);
+
+                auto df = [&](auto p, X x, X dx) { return (p(x + dx) - p(x - dx))/(2*dx); };
+                X gamma = df([&](X f_) { return black::delta(f_, sigma, k, t); }, f, h*f);
+                X theta = -df([&](X t_) { return black::value(f, sigma, k, t_); }, t, h*t);
+                X vanna = df([&](X s_) { return black::delta(f, s_, k, t); }, sigma, h*sigma);
+                X volga = df([&](X s_) { return black::vega(f, s_, k, t); }, sigma, h*sigma);
+                ensure (fabs(g.gamma - gamma) <= tol*(1 + fabs(gamma)));
+                ensure (fabs(g.theta - theta) <= tol*(1 + fabs(theta)));
+                ensure (fabs(g.vanna - vanna) <= tol*(1 + fabs(vanna)));
+                ensure (fabs(g.volga - volga) <= tol*(1 + fabs(volga)));
+
+                auto b = fms::bsm::risk(r, f, sigma, k, t, true);
+                auto v = [&](X r_, X s_, X sigma_, X t_) { return fms::bsm::value(r_, s_, sigma_, k, t_); };
+                X bdelta = df([&](X s_) { return v(r, s_, sigma, t); }, f, h*f);
+                X bgamma = df([&](X s_) { return fms::bsm::delta(r, s_, sigma, k, t); }, f, h*f);
+                X btheta = -df([&](X t_) { return v(r, f, sigma, t_); }, t, h*t);
+                X bvega = df([&](X sigma_) { return v(r, f, sigma_, t); }, sigma, h*sigma);
+                ensure (fabs(b.value - v(r, f, sigma, t)) <= 4*eps*k);
+                ensure (fabs(b.delta - bdelta) <= tol*(1 + fabs(bdelta)));
+                ensure (fabs(b.gamma - bgamma) <= tol*(1 + fabs(bgamma)));
+                ensure (fabs(b.theta - btheta) <= tol*(1 + fabs(btheta)));
+                ensure (fabs(b.vega - bvega) <= tol*(1 + fabs(bvega)));
+            }
+        }
+    }
+
+    // edges
+    auto g0 = black::risk(f, X(0), X(90), X(1));
+    ensure (g0.value == 0 && g0.delta == 0 && g0.gamma == 0 && g0.vega == 0);
+    g0 = black::risk(f, X(0.2), X(0), X(1));
+    ensure (g0.value == 0 && g0.delta == 0);
+    ensure (black::risk(f, X(0.2), X(90), X(1)).vanna == 0);
+
+    // 400 strikes by 40 expiries
+    std::vector<X> f_, sigma_, k_, t_, r_;
+    for (size_t j = 1; j <= 40; ++j) {
+        for (size_t i = 1; i <= 400; ++i) {
+            f_.push_back(X(100));
+            sigma_.push_back(X(0.2) + X(i)/4000);
+            k_.push_back(X(i)/2);
+            t_.push_back(X(j)/8);
+            r_.push_back(r);
+        }
+    }
+    size_t n = f_.size();
+    std::vector<black::greeks<X>> g(n), b(n);
+    black::risk(n, f_.data(), sigma_.data(), k_.data(), t_.data(), g.data(), true);
+    fms::bsm::risk(n, r_.data(), f_.data(), sigma_.data(), k_.data(), t_.data(), b.data(), true);
+    for (size_t i = 0; i < n; ++i) {
+        auto gi = black::risk(f_[i], sigma_[i], k_[i], t_[i], true);
+        ensure (fabs(g[i].value - gi.value) <= 16*eps*k_[i]);
+        ensure (fabs(g[i].delta - gi.delta) <= 16*eps);
+        ensure (fabs(g[i].gamma - gi.gamma) <= 16*eps*(1 + gi.gamma));
+        ensure (fabs(g[i].vega - gi.vega) <= 16*eps*(1 + gi.vega));
+        ensure (fabs(g[i].theta - gi.theta) <= 16*eps*(1 + fabs(gi.theta)));
+        // z and z - s lose digits to the vector log
+        ensure (fabs(g[i].vanna - gi.vanna) <= 16*eps*(1 + 1/sigma_[i]));
+        ensure (fabs(g[i].volga - gi.volga) <= 16*eps*(1 + fabs(gi.volga) + gi.vega/sigma_[i]));
+        auto bi = fms::bsm::risk(r_[i], f_[i], sigma_[i], k_[i], t_[i], true);
+        ensure (fabs(b[i].value - bi.value) <= 16*eps*k_[i]);
+        ensure (fabs(b[i].theta - bi.theta) <= 16*eps*(1 + fabs(bi.theta)));
+    }
+
+    // cost per fully risked option
+    double secs, options;
+    X v = 0;
+    secs = timer([&]() {
+        for (size_t i = 0; i < n; ++i) {
+            v += black::value(f_[i], sigma_[i], k_[i], t_[i]);
+            v += black::delta(f_[i], sigma_[i], k_[i], t_[i]);
+            v += black::vega(f_[i], sigma_[i], k_[i], t_[i]);
+        }
+    }, 10);
+    options = 10*n/secs;
+    options = options;
+    secs = timer([&]() {
+        for (size_t i = 0; i < n; ++i) {
+            v += black::risk(f_[i], sigma_[i], k_[i], t_[i]).value;
+        }
+    }, 10);
+    options = 10*n/secs;
+    options = options;
+    secs = timer([&]() {
+        black::risk(n, f_.data(), sigma_.data(), k_.data(), t_.data(), g.data());
+    }, 10);
+    options = 10*n/secs;
+    options = options;
+    v = v;
 }
 
 
@@ -264,7 +780,10 @@ void test_fms_black()
     test_fms_black_value<X>();
     test_fms_black_delta<X>();
     test_fms_black_vega<X>();
+    test_fms_black_edge<X>();
     test_fms_black_implied<X>();
+    test_fms_black_batch<X>();
+    test_fms_black_greeks<X>();
 }
 
 template<class X>
@@ -339,88 +858,714 @@ void test_fms_analytic()
     }
 }
 
+// y = x + x^2 + ... + x^9 at x I + J using analytic<X,N> and analytic<X>
+template<class X, size_t N>
+void test_fms_analytic_fixed_order()
+{
+    using fms::analytic;
+
+    analytic<X,N> x{X(0.5),X(1)};
+    analytic<X> x_(N);
+    x_ += analytic<X>{X(0.5),X(1)};
+    ensure (x == x_);
+
+    auto f = [](const auto& x) {
+        auto y = x;
+        for (int k = 0; k < 8; ++k) {
+            y = fms::lazy::expr(y)*x + x;
+        }
+        return y;
+    };
+
+    size_t a = allocations;
+    auto y = f(x);
+    ensure (allocations == a);
+    auto y_ = f(x_);
+    size_t a_ = allocations - a;
+    ensure (a_ == 1); // only the copy, y*x + x is evaluated in place
+    ensure (y == y_);
+
+    // sum_{1<=k<=9} k x^{k-1}
+    X dy = 0;
+    for (int k = 9; k > 0; --k) {
+        dy = dy*X(0.5) + k;
+    }
+    ensure (fabs(y(1) - dy) <= 8*std::numeric_limits<X>::epsilon()*dy);
+
+    size_t count = 100000;
+    double secs;
+    X s = 0;
+    secs = timer([&]() { s += f(x)[N - 1]; }, count);
+    secs = secs;
+    secs = timer([&]() { s += f(x_)[N - 1]; }, count);
+    secs = secs;
+    ensure (s == s);
+}
+
 template<class X>
-void test_fms_pwflat()
+void test_fms_analytic_fixed()
 {
-    using namespace fms::pwflat;
+    using fms::analytic;
 
-    std::vector<X> t{1.,2.,3.}, f{.1,.2,.3};
-    std::vector<X> t_2{ 1. }, f_2{ .1 };
+    {
+        constexpr analytic<X,3> x{X(2),X(1)};
+        static_assert (x.order() == 3);
+        static_assert (x[0] == X(2) && x[1] == X(1) && x[2] == X(0));
 
-    { // monotonic
-        ensure (strictly_increasing(std::begin(t), std::end(t)));
-        ensure (strictly_increasing(std::begin(f), std::end(f)));
-        X f2 = f[2];
-        f[2] = -1;
-        ensure (!strictly_increasing(std::begin(f), std::end(f)));
-        f[2] = f2;
-        ensure (!strictly_increasing(std::rbegin(f), std::rend(f)));
+        // (2 + J)*(2 + J) = 4 + 2*2J + J^2
+        constexpr auto x2 = x*x;
+        static_assert (x2[0] == X(4) && x2[1] == X(4) && x2[2] == X(1));
+        static_assert (x2(2) == X(2));
+        static_assert (x2 - x*x == analytic<X,1>{});
+        static_assert (x2 + x == analytic<X,3>{X(6),X(5),X(1)});
+
+        // mixed orders truncate to the left operand
+        constexpr auto x3 = x*analytic<X,2>{X(2),X(1)};
+        static_assert (x3 == x2);
+        constexpr auto x4 = analytic<X,2>{X(2),X(1)}*x;
+        static_assert (x4 == analytic<X,2>{X(4),X(4)});
+        static_assert (x4 != x2);
+
+        analytic<X,3> y;
+        y = X(3);
+        ensure (y == analytic<X>{X(3)});
+        y += x;
+        ensure ((y == analytic<X>{X(5),X(1)}));
+        y -= analytic<X>{X(5),X(1),X(0),X(7)};
+        ensure (y == analytic<X>(2));
+        static_assert (sizeof(analytic<X,3>) == 3*sizeof(X));
     }
-    { // forward
-      //0, 0, null, null, null
-        ensure (isnan(value<int,X>(0, 0, nullptr, nullptr)));
-        //1, 0, null, null, null
-        ensure(isnan(value<int, X>(1, 0, nullptr, nullptr)));
-        //-1, 0, null, null, null
-        ensure(isnan(value<int, X>(-1, 0, nullptr, nullptr)));
-        //-1, 0, null, null, 0.2
-        ensure(isnan(value<int, X>(-1, 0, nullptr, nullptr, 0.2)));
 
-        int u;
-        u = 1;
-        X x{ 0.2 }, x_;
-        //1, 0, null, null, 0.2
-        x_ = fms::pwflat::value<int, X>(u, 0, nullptr, nullptr, x);
-        ensure(x_ == x);
+    test_fms_analytic_fixed_order<X,2>();
+    test_fms_analytic_fixed_order<X,3>();
+    test_fms_analytic_fixed_order<X,4>();
+    test_fms_analytic_fixed_order<X,5>();
+    test_fms_analytic_fixed_order<X,6>();
+    test_fms_analytic_fixed_order<X,7>();
+    test_fms_analytic_fixed_order<X,8>();
+}
 
-        X u_ [] = { -1, 0, 0.5, 1, 1.5 };
-        X a_ [] = { 0, 0.1, 0.1, 0.1, 0.2 };
+// truncated products and the crossover orders in fms::taylor
+template<class X>
+void test_fms_analytic_product()
+{
+    using namespace fms::taylor;
 
-        for (int i = 0; i < 5; i++) {
-            if (i == 0 || i == 4) {
-                ensure(isnan(value<X, X>(u_[i], t_2.size(), t_2.data(), f_2.data())));
-            }
-            else {
-                x_ = fms::pwflat::value<X, X>(u_[i], t_2.size(), t_2.data(), f_2.data());
-                ensure(x_ == a_[i]);
+    X eps = std::numeric_limits<X>::epsilon();
+    std::default_random_engine dre;
+    std::uniform_real_distribution<X> u(-1, 1);
+
+    for (size_t n : {1, 2, 5, 8, 9, 16, 33, 100, 191, 192, 193, 383, 384, 385, 1000}) {
+        std::vector<X> a(n), b(n), c(n), d(n), a_(n), b_(n), e(n);
+        for (size_t i = 0; i < n; ++i) {
+            a[i] = u(dre);
+            b[i] = u(dre);
+            a_[i] = fabs(a[i]);
+            b_[i] = fabs(b[i]);
+        }
+        schoolbook(n, a.data(), b.data(), c.data());
+        schoolbook(n, a_.data(), b_.data(), e.data());
+        X emax = *std::max_element(e.begin(), e.end());
+
+        auto close = [&](X tol) {
+            for (size_t k = 0; k < n; ++k) {
+                if (fabs(d[k] - c[k]) > tol*eps*emax) {
+                    return false;
+                }
             }
+            return true;
+        };
+        karatsuba(n, a.data(), b.data(), d.data());
+        ensure (close(8));
+        fft(n, a.data(), b.data(), d.data());
+        ensure (close(8));
+        product(n, a.data(), b.data(), d.data());
+        ensure (close(8));
+    }
+
+    {
+        // coefficients of exp(J) times themselves are 2^k/k!
+        size_t n = 1000;
+        fms::analytic<X> x(n);
+        x += fms::analytic<X>{X(0), X(1)};
+        auto e = exp(x);
+        auto e2 = e*e;
+        X c = 1;
+        for (size_t k = 0; k < 20; ++k) {
+            ensure (fabs(e2[k] - c) <= 16*eps);
+            c *= 2/X(k + 1);
         }
+    }
 
-        for (int i = 0; i < 5; i++) {
-            if (i == 0) {
-                ensure(isnan(value<X, X>(u_[i], t_2.size(), t_2.data(), f_2.data(), 0.2)));
-            }
-            else {
-                x_ = fms::pwflat::value<X, X>(u_[i], t_2.size(), t_2.data(), f_2.data(), 0.2);
-                ensure(x_ == a_[i]);
+    // full products across the base case
+    for (size_t n : {1, 2, 23, 24, 25, 48, 49, 100}) {
+        std::vector<X> a(n), b(n), c(2*n - 1), d(2*n - 1), e(2*n - 1), w(6*n);
+        for (size_t i = 0; i < n; ++i) {
+            a[i] = u(dre);
+            b[i] = u(dre);
+        }
+        std::fill(c.begin(), c.end(), X(0));
+        std::fill(e.begin(), e.end(), X(0));
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < n; ++j) {
+                c[i + j] += a[i]*b[j];
+                e[i + j] += fabs(a[i]*b[j]);
             }
         }
-
-        for (int i = 0; i < 3; ++i)
-            ensure (f[i] == value(t[i], t.size(), t.data(), f.data()));
+        karatsuba_full(n, a.data(), b.data(), d.data(), w.data());
+        for (size_t k = 0; k < 2*n - 1; ++k) {
+            ensure (fabs(d[k] - c[k]) <= 8*eps*(1 + e[k]));
+        }
     }
-    { // integral
-        X u;
-        u = -1;
-        ensure (isnan(integral(u, t.size(), t.data(), f.data())));
-        u = 4;
-        ensure (isnan(integral(u, t.size(), t.data(), f.data())));
-        u = 0;
-        ensure (0 == integral(u, t.size(), t.data(), f.data()));
-        u = 0.5;
-        ensure (.1*.5 == integral(u, t.size(), t.data(), f.data()));
-        u = 1;
-        ensure (.1 == integral(u, t.size(), t.data(), f.data()));
-        u = 1.5;
-        ensure (.1 + .2*.5 == integral(u, t.size(), t.data(), f.data()));
-        u = 2.5;
-        ensure (.1 + .2 + .3*.5 == integral(u, t.size(), t.data(), f.data()));
-        u = 3;
-        ensure (fabs(.1 + .2 + .3 - integral(u, t.size(), t.data(), f.data())) < 1e-10);
-        //		ensure (.1 + .2 + .3 != .6); 
+
+    // time each method to pick unrolled_order, karatsuba_order, and fft_order
+    for (size_t n : {4, 8, 16, 32, 64, 128, 256, 384, 512, 1024, 2048}) {
+        std::vector<X> a(n), b(n), c(n);
+        for (size_t i = 0; i < n; ++i) {
+            a[i] = u(dre);
+            b[i] = u(dre);
+        }
+
+        size_t count = 1 + 1000000/(n*n);
+        double secs;
+        secs = timer([&]() { schoolbook(n, a.data(), b.data(), c.data()); }, count);
+        secs = secs;
+        secs = timer([&]() { karatsuba(n, a.data(), b.data(), c.data()); }, count);
+        secs = secs;
+        secs = timer([&]() { fft(n, a.data(), b.data(), c.data()); }, count);
+        secs = secs;
+        secs = timer([&]() { product(n, a.data(), b.data(), c.data()); }, count);
+        secs = secs;
     }
-    { // discount
-        X u_[] = { -.5, 0, .5, 1, 1.5, 2, 2.5, 3, 3.5 };
+}
+
+// lazy expressions agree with the eager fixed order operators
+template<class X>
+void test_fms_analytic_lazy()
+{
+    using fms::analytic;
+    using fms::lazy::expr;
+
+    analytic<X,5> a{X(2), X(1), X(0.5), X(-1), X(3)};
+    analytic<X,3> b{X(3), X(-2), X(0.25)};
+    analytic<X,5> c{X(-1), X(0.5), X(2), X(1), X(-0.5)};
+    analytic<X,2> d{X(0.5), X(4)};
+    analytic<X,4> e{X(1), X(1), X(1), X(1)};
+    // same coefficients and order
+    auto same = [](const auto& x, const analytic<X>& y) {
+        return x.order() == y.order() && x == y;
+    };
+    auto lazy = [](const auto& x) {
+        analytic<X> y(x.order());
+        for (size_t k = 0; k < x.order(); ++k) {
+            y[k] = x[k];
+        }
+        return y;
+    };
+    analytic<X> a_ = lazy(a), b_ = lazy(b), c_ = lazy(c), d_ = lazy(d), e_ = lazy(e);
+
+    {
+        // mixed orders
+        ensure (same(a*b + c*d - e, a_*b_ + c_*d_ - e_));
+        ensure (same(b*a - e, b_*a_ - e_));
+        ensure (same(e - a*b, e_ - a_*b_));
+        ensure (same((a + b)*(c - d)/b, (a_ + b_)*(c_ - d_)/b_));
+        ensure (same(d*(a*b), d_*(a_*b_)));
+        ensure (same(a + (b*c + d), a_ + (b_*c_ + d_)));
+        ensure (same(a*b*c/e/d, a_*b_*c_/e_/d_));
+        // scalars
+        ensure (same(X(2)*a - X(1), X(2)*a_ - X(1)));
+        ensure (same(X(1) - b*a, X(1) - b_*a_));
+        ensure (same(X(1)/a, X(1)/a_));
+        ensure (same(-a*b/X(2) + X(3), -a_*b_/X(2) + X(3)));
+        ensure (same(X(2)*(a*b) - (c*d)*X(3), X(2)*(a_*b_) - (c_*d_)*X(3)));
+        // functions
+        ensure (same(exp(a*b)*c, exp(a_*b_)*c_));
+        ensure (same(sqrt(a*a + c*c), sqrt(a_*a_ + c_*c_)));
+    }
+    {
+        // lazy
+        ensure (same(a*b + c*d - e, expr(a_)*b_ + expr(c_)*d_ - e_));
+        ensure (same(b*a - e, expr(b_)*a_ - e_));
+        ensure (same(e - a*b, e_ - expr(a_)*b_));
+        ensure (same((a + b)*(c - d)/b, (expr(a_) + b_)*(expr(c_) - d_)/b_));
+        ensure (same(d*(a*b), expr(d_)*(expr(a_)*b_)));
+        ensure (same(a + (b*c + d), expr(a_) + (expr(b_)*c_ + d_)));
+        ensure (same(a*b*c/e/d, expr(a_)*b_*c_/e_/d_));
+        ensure (same(X(2)*a - X(1), X(2)*expr(a_) - X(1)));
+        ensure (same(X(1) - b*a, X(1) - expr(b_)*a_));
+        ensure (same(X(1)/a, X(1)/expr(a_)));
+        ensure (same(-a*b/X(2) + X(3), -expr(a_)*b_/X(2) + X(3)));
+        ensure (same(X(2)*(a*b) - (c*d)*X(3), X(2)*(expr(a_)*b_) - (expr(c_)*d_)*X(3)));
+        ensure (same(exp(a*b)*c, expr(exp(expr(a_)*b_))*c_));
+        ensure (same(sqrt(a*a + c*c), sqrt(expr(a_)*a_ + expr(c_)*c_)));
+    }
+    {
+        // eager operators do not refer to their operands
+        auto square = [](const analytic<X>& x) {
+            analytic<X> y = x;
+            y += analytic<X>{X(1)};
+            return y*y;
+        };
+        analytic<X> y = square(analytic<X>{X(2), X(1), X(0)});
+        ensure (y[0] == 9 && y[1] == 6 && y[2] == 1);
+    }
+    {
+        // expressions compare and index by value
+        auto z = expr(a_)*b_ + c_;
+        analytic<X> z_ = z;
+        ensure (z == z_);
+        ensure (z_ == z);
+        ensure (z == a*b + c);
+        ensure (a*b + c == z);
+        ensure (z == c_ + expr(a_)*b_);
+        ensure (z != z_ + X(1));
+        ensure (z != a_);
+        ensure (expr(a_)*b_ - expr(a_)*b_ == X(0));
+        auto q = expr(a_)/c_;
+        for (size_t k = 0; k < z_.order(); ++k) {
+            ensure (z[k] == z_[k]);
+            ensure (q[k] == (a/c)[k]);
+        }
+    }
+    {
+        // destination is an operand
+        analytic<X,5> y = a;
+        analytic<X> y_ = a_;
+        for (int k = 0; k < 3; ++k) {
+            y = y*b + a;
+            y_ = expr(y_)*b_ + a_;
+            y = c*y - y*d;
+            y_ = expr(c_)*y_ - expr(y_)*d_;
+            y = y*(y - c)*y;
+            y_ = expr(y_)*(expr(y_) - c_)*y_;
+            y = (y + e)/y + a/y;
+            y_ = (expr(y_) + e_)/y_ + expr(a_)/y_;
+        }
+        ensure (same(y, y_));
+        y += y*d;
+        y_ += expr(y_)*d_;
+        y -= d*y;
+        y_ -= expr(d_)*y_;
+        y *= y + b;
+        y_ *= expr(y_) + b_;
+        y /= a*c;
+        y_ /= expr(a_)*c_;
+        y /= y;
+        y_ /= expr(y_);
+        ensure (same(y, y_));
+        // orders change
+        y_ = b_;
+        y_ = expr(a_) + y_;
+        ensure (same(a + b, y_));
+        y_ = expr(b_)*y_;
+        ensure (same(b*(a + b), y_));
+    }
+    {
+        // only the destination is allocated
+        analytic<X> z(5);
+        size_t n = allocations;
+        z = expr(a_)*b_ + expr(c_)*d_ - e_;
+        z = X(2)*expr(a_) - expr(b_)*c_/X(3);
+        z = (expr(a_) + c_)/(expr(e_) - X(1)) + X(1);
+        z *= expr(a_) + b_;
+        z /= c_;
+        ensure (allocations == n);
+        analytic<X> w = expr(a_)*b_ + expr(c_)*d_ - e_;
+        ensure (allocations == n + 1);
+        // products of elementwise operands only use coefficients j <= k
+        w = expr(w)*b_ + expr(w)*w - X(2)*expr(w);
+        ensure (allocations == n + 1);
+        w = (expr(w) + a_)/w;
+        ensure (allocations == n + 2);
+        analytic<X,5> v = a*b + c*d - e;
+        v = v*b + v*v - X(2)*v;
+        v = (v + a)/v;
+        ensure (same(v, w));
+    }
+
+    // greeks of a Black call using erfc, lazy and eager
+    X f = 100, s = X(0.2), k = 90, sqrt2 = X(fms::prob::sqrt2);
+    auto black = [=](const analytic<X>& f) {
+        analytic<X> d1 = expr(log(expr(f)/k))/s + s/2;
+        analytic<X> v = expr(f)*erfc(-expr(d1)/sqrt2)/X(2) - k*expr(erfc((s - expr(d1))/sqrt2))/X(2);
+        return v;
+    };
+    auto black_ = [=](const analytic<X>& f) {
+        analytic<X> d1 = log(f/k)/s + s/2;
+        analytic<X> v = f*erfc(-d1/sqrt2)/X(2) - k*erfc((s - d1)/sqrt2)/X(2);
+        return v;
+    };
+    // gamma times f^2 s
+    auto gamma = [=](const analytic<X>& f, const analytic<X>& d1) {
+        analytic<X> g = expr(exp(-expr(d1)*d1/X(2)))*f*X(fms::prob::sqrt1_2pi);
+        return g;
+    };
+    auto gamma_ = [=](const analytic<X>& f, const analytic<X>& d1) {
+        analytic<X> g = exp(-d1*d1/X(2))*f*X(fms::prob::sqrt1_2pi);
+        return g;
+    };
+
+    for (size_t n : {2, 4, 8}) {
+        analytic<X> f_(n);
+        f_ += analytic<X>{f, 1};
+        analytic<X> d1 = log(f_/k)/s + s/2;
+        ensure (black(f_) == black_(f_));
+        ensure (gamma(f_, d1) == gamma_(f_, d1));
+        analytic<X> z = expr(a_)*b_ + expr(c_)*d_ - e_;
+        ensure (z == a_*b_ + c_*d_ - e_);
+
+        size_t m = allocations;
+        black(f_);
+        size_t m_ = allocations;
+        black_(f_);
+        ensure (allocations - m_ > m_ - m);
+
+        size_t count = 100000;
+        double secs;
+        X sum = 0;
+        secs = timer([&]() { z = expr(a_)*b_ + expr(c_)*d_ - e_; sum += z[0]; }, count);
+        secs = secs;
+        secs = timer([&]() { sum += (a_*b_ + c_*d_ - e_)[0]; }, count);
+        secs = secs;
+        secs = timer([&]() { sum += black(f_)[n - 1]; }, count);
+        secs = secs;
+        secs = timer([&]() { sum += black_(f_)[n - 1]; }, count);
+        secs = secs;
+        secs = timer([&]() { sum += gamma(f_, d1)[n - 1]; }, count);
+        secs = secs;
+        secs = timer([&]() { sum += gamma_(f_, d1)[n - 1]; }, count);
+        secs = secs;
+        ensure (sum == sum);
+    }
+}
+
+// derivatives of elementary functions and pricers in one evaluation
+template<class X>
+void test_fms_analytic_functions()
+{
+    using fms::analytic;
+
+    X eps = std::numeric_limits<X>::epsilon();
+    auto close = [eps](X a, X b, X tol) { return fabs(a - b) <= tol*eps*(1 + fabs(b)); };
+
+    {
+        constexpr size_t N = 5;
+        X x0 = X(0.7), p = X(2.5);
+        analytic<X,N> x{x0, X(1)};
+
+        auto e = exp(x);
+        auto l = log(x);
+        auto s = sqrt(x);
+        auto xp = pow(x, p);
+        auto q = X(1)/x;
+        auto erfx = erf(x);
+        auto erfcx = erfc(x);
+        auto Nx = prob::normal_cdf(x);
+        auto nx = prob::normal_pdf(x);
+
+        X dl = 1/x0;                // (log x)'
+        X ds = std::sqrt(x0);       // sqrt^(k)
+        X dp = std::pow(x0, p);     // (x^p)^(k)
+        X dq = 1/x0;                // (1/x)^(k)
+        X He = 1, He_ = 0;          // Hermite polynomials, phi^(k) = (-1)^k He_k phi
+        X phi = prob::normal_pdf(x0);
+        for (size_t k = 0; k < N; ++k) {
+            ensure (close(e(k), std::exp(x0), 4));
+            if (k > 0) {
+                ensure (close(l(k), dl, 16));
+                dl *= -X(k)/x0;
+            }
+            ensure (close(s(k), ds, 16));
+            ds *= (X(0.5) - k)/x0;
+            ensure (close(xp(k), dp, 16));
+            dp *= (p - k)/x0;
+            ensure (close(q(k), dq, 16));
+            dq *= -X(k + 1)/x0;
+
+            X phik = (k & 1 ? -He : He)*phi;
+            ensure (close(nx(k), phik, 16));
+            ensure (close(Nx(k + 1 < N ? k + 1 : 0), k + 1 < N ? phik : prob::normal_cdf(x0), 16));
+            // erf(x) = 2 N(sqrt(2) x) - 1
+            ensure (close(erfx(k), 2*std::pow(X(prob::sqrt2), X(k))*prob::normal_cdf(analytic<X,N>{X(prob::sqrt2)*x0, 1})(k) - (k == 0), 16));
+            ensure (close(erfcx(k), (k == 0 ? 1 : 0) - erfx(k), 16));
+            X He1 = x0*He - k*He_;
+            He_ = He;
+            He = He1;
+        }
+
+        ensure (pow(x, analytic<X,N>{p}) != xp);
+        for (size_t k = 0; k < N; ++k) {
+            ensure (close(pow(x, analytic<X,N>{p})(k), xp(k), 256));
+            ensure (close((e*l/e)(k), l(k), 16));
+            ensure (close((s*s)(k), x(k), 16));
+        }
+        ensure (x*x/x == x);
+
+        // run time order
+        analytic<X> y(N);
+        y += analytic<X>{x0, X(1)};
+        ensure (exp(x) == exp(y));
+        ensure (log(x) == log(y));
+        ensure (sqrt(x) == sqrt(y));
+        ensure (pow(x, p) == pow(y, p));
+        ensure (erf(x) == erf(y));
+        ensure (X(1)/x == X(1)/y);
+        ensure (fms::taylor::normal_cdf(x) == fms::taylor::normal_cdf(y));
+    }
+    {
+        X f = 100, sigma = X(0.2), k = 90, t = X(0.5), r = X(0.05);
+        auto g = black::risk(f, sigma, k, t, true);
+
+        auto vf = black::value(analytic<X,4>{f, 1}, sigma, k, t);
+        ensure (close(vf(0), g.value, 16*k));
+        ensure (close(vf(1), g.delta, 16));
+        ensure (close(vf(2), g.gamma, 64));
+        // speed = -gamma (1 + z/s)/f where z = d1
+        X s = sigma*sqrt(t), z = (log(f/k) + s*s/2)/s;
+        ensure (close(vf(3), -g.gamma*(1 + z/s)/f, 1024));
+
+        auto vs = black::value(f, analytic<X,3>{sigma, 1}, k, t);
+        ensure (close(vs(1), g.vega, 64*k));
+        ensure (close(vs(2), g.volga, 1024*k));
+        auto ds = black::delta(f, analytic<X,2>{sigma, 1}, k, t);
+        ensure (close(ds(1), g.vanna, 1024));
+        auto vt = black::value(f, sigma, k, analytic<X,2>{t, 1});
+        ensure (close(-vt(1), g.theta, 64*k));
+        auto gs = black::vega(analytic<X,2>{f, 1}, sigma, k, t);
+        ensure (close(gs(1), g.vanna, 1024));
+
+        auto b = bsm::risk(r, f, sigma, k, t);
+        auto vb = bsm::value(r, analytic<X,3>{f, 1}, sigma, k, t);
+        ensure (close(vb(0), b.value, 16*k));
+        ensure (close(vb(1), b.delta, 16));
+        ensure (close(vb(2), b.gamma, 64));
+        auto vr = bsm::value(analytic<X,3>{r, 1}, f, sigma, k, t);
+        ensure (close(vr(0), b.value, 16*k));
+        // rho = -t (value - f delta) since D v_B(s/D) depends on r only through D
+        ensure (close(vr(1), -t*(b.value - f*b.delta), 64*k));
+
+        // value, delta, gamma, and speed in one pass or by bumping the forward
+        X h = cbrt(eps)*f;
+        auto fd = [&]() {
+            X v[5];
+            for (int i = -2; i <= 2; ++i) {
+                v[i + 2] = black::value(f + i*h, sigma, k, t);
+            }
+            return std::array<X,4>{v[2], (v[3] - v[1])/(2*h), (v[3] - 2*v[2] + v[1])/(h*h),
+                (v[4] - 2*v[3] + 2*v[1] - v[0])/(2*h*h*h)};
+        };
+        auto d = fd();
+        ensure (fabs(d[1] - vf(1)) <= 1e-4);
+        ensure (fabs(d[2] - vf(2)) <= 1e-3);
+
+        size_t count = 100000;
+        double secs;
+        X sum = 0;
+        secs = timer([&]() { sum += black::value(analytic<X,4>{f, 1}, sigma, k, t)[3]; }, count);
+        secs = secs;
+        secs = timer([&]() { sum += fd()[3]; }, count);
+        secs = secs;
+        ensure (sum == sum);
+    }
+    {
+        // parallel shift of forward rates multiplies the discount by exp(-u h)
+        X t[] = {1, 2, 3};
+        X f[] = {X(0.01), X(0.02), X(0.03)};
+        analytic<X,4> f_[] = {{f[0], 1}, {f[1], 1}, {f[2], 1}};
+
+        for (X u : {X(0.5), X(2.5), X(3)}) {
+            auto D_ = pwflat::discount(u, 3, t, f_);
+            X D = pwflat::discount(u, 3, t, f);
+            for (size_t k = 0; k < 4; ++k) {
+                ensure (close(D_(k), std::pow(-u, X(k))*D, 16));
+            }
+            ensure (close(pwflat::spot(u, 3, t, f_)(1), 1, 16));
+        }
+        auto D_ = pwflat::discount(X(4), 3, t, f_);
+        ensure (D_[0] != D_[0]);
+    }
+}
+
+template<class X>
+void test_fms_jet()
+{
+    using fms::jet;
+
+    X eps = std::numeric_limits<X>::epsilon();
+    auto close = [eps](X a, X b, X tol) { return fabs(a - b) <= tol*eps*(1 + fabs(b)); };
+
+    {
+        using J = jet<X,2,2>;
+        static_assert (J::size() == 6);
+        static_assert (jet<X,3,3>::size() == 20);
+
+        constexpr auto x = J::variable(0, X(2));
+        constexpr auto y = J::variable(1, X(3));
+        constexpr auto xy = x*y;
+        static_assert (xy[0] == X(6));
+        static_assert (xy({1,0}) == X(3) && xy({0,1}) == X(2) && xy({1,1}) == X(1));
+        static_assert (xy({2,0}) == X(0) && xy({2,1}) == X(0));
+        static_assert ((xy*xy)({1,1}) == X(4*6));
+        static_assert ((xy*xy)({2,0}) == X(2*9));
+        static_assert (xy - x*y == J{});
+        static_assert (X(2)*x - x == x && x + X(1) == X(1) + x);
+        static_assert (x < y && x == J::variable(0, X(2)) && xy != X(6));
+    }
+    {
+        // exp(x y) + log(x)/y
+        using J = jet<X,2,3>;
+        X x0 = X(0.5), y0 = X(1.5);
+        auto x = J::variable(0, x0), y = J::variable(1, y0);
+        auto f = exp(x*y) + log(x)/y;
+        X e = std::exp(x0*y0);
+
+        ensure (close(f({0,0}), e + std::log(x0)/y0, 4));
+        ensure (close(f({1,0}), y0*e + 1/(x0*y0), 4));
+        ensure (close(f({0,1}), x0*e - std::log(x0)/(y0*y0), 4));
+        ensure (close(f({2,0}), y0*y0*e - 1/(x0*x0*y0), 8));
+        ensure (close(f({1,1}), (1 + x0*y0)*e - 1/(x0*y0*y0), 8));
+        ensure (close(f({0,2}), x0*x0*e + 2*std::log(x0)/(y0*y0*y0), 8));
+        ensure (close(f({2,1}), (2*y0 + x0*y0*y0)*e + 1/(x0*x0*y0*y0), 16));
+        ensure (close(f({0,3}), x0*x0*x0*e - 6*std::log(x0)/(y0*y0*y0*y0), 16));
+        ensure (f({3,1}) == 0);
+    }
+    {
+        // one variable agrees with analytic
+        using J = jet<X,1,4>;
+        X x0 = X(0.7);
+        auto x = J::variable(0, x0);
+        fms::analytic<X,5> a{x0, X(1)};
+        auto same = [&](const J& f, const fms::analytic<X,5>& g) {
+            for (size_t k = 0; k < 5; ++k) {
+                if (!close(f({k}), g(k), 64)) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        ensure (same(sqrt(x), sqrt(a)));
+        ensure (same(pow(x, X(2.5)), pow(a, X(2.5))));
+        ensure (same(pow(x, x), pow(a, a)));
+        ensure (same(erf(x), erf(a)));
+        ensure (same(erfc(x), erfc(a)));
+        ensure (same(X(1)/(x*x + X(1)), X(1)/(a*a + X(1))));
+        ensure (same(prob::normal_cdf(x), prob::normal_cdf(a)));
+        ensure (same(prob::normal_pdf(x), prob::normal_pdf(a)));
+    }
+    {
+        // Black value with respect to forward, volatility, and time
+        using J = jet<X,3,3>;
+        X f = 100, sigma = X(0.2), k = 90, t = X(0.5);
+        auto g = black::risk(f, sigma, k, t, true);
+        auto v = black::value(J::variable(0, f), J::variable(1, sigma), k, J::variable(2, t));
+
+        ensure (close(v({0,0,0}), g.value, 16*k));
+        ensure (close(v({1,0,0}), g.delta, 16));
+        ensure (close(v({2,0,0}), g.gamma, 64));
+        ensure (close(v({0,1,0}), g.vega, 64*k));
+        ensure (close(v({1,1,0}), g.vanna, 1024));
+        ensure (close(v({0,2,0}), g.volga, 1024*k));
+        ensure (close(-v({0,0,1}), g.theta, 64*k));
+        auto vf = black::value(fms::analytic<X,4>{f, 1}, sigma, k, t);
+        ensure (close(v({3,0,0}), vf(3), 1024));
+
+        // all greeks to order 3 in one call or order 2 by black::risk
+        size_t count = 10000;
+        double secs;
+        X sum = 0;
+        secs = timer([&]() { sum += black::value(J::variable(0, f), J::variable(1, sigma), k, J::variable(2, t))[1]; }, count);
+        secs = secs;
+        secs = timer([&]() { sum += black::value(jet<X,3,2>::variable(0, f), jet<X,3,2>::variable(1, sigma), k, jet<X,3,2>::variable(2, t))[1]; }, count);
+        secs = secs;
+        secs = timer([&]() { sum += black::risk(f, sigma, k, t, true).vanna; }, count);
+        secs = secs;
+        ensure (sum == sum);
+    }
+}
+
+template<class X>
+void test_fms_pwflat()
+{
+    using namespace fms::pwflat;
+
+    std::vector<X> t{1.,2.,3.}, f{.1,.2,.3};
+    std::vector<X> t_2{ 1. }, f_2{ .1 };
+
+    { // monotonic
+        ensure (strictly_increasing(std::begin(t), std::end(t)));
+        ensure (strictly_increasing(std::begin(f), std::end(f)));
+        X f2 = f[2];
+        f[2] = -1;
+        ensure (!strictly_increasing(std::begin(f), std::end(f)));
+        f[2] = f2;
+        ensure (!strictly_increasing(std::rbegin(f), std::rend(f)));
+    }
+    { // forward
+      //0, 0, null, null, null
+        ensure (isnan(value<int,X>(0, 0, nullptr, nullptr)));
+        //1, 0, null, null, null
+        ensure(isnan(value<int, X>(1, 0, nullptr, nullptr)));
+        //-1, 0, null, null, null
+        ensure(isnan(value<int, X>(-1, 0, nullptr, nullptr)));
+        //-1, 0, null, null, 0.2
+        ensure(isnan(value<int, X>(-1, 0, nullptr, nullptr, 0.2)));
+
+        int u;
+        u = 1;
+        X x{ 0.2 }, x_;
+        //1, 0, null, null, 0.2
+        x_ = fms::pwflat::value<int, X>(u, 0, nullptr, nullptr, x);
+        ensure(x_ == x);
+
+        X u_ [] = { -1, 0, 0.5, 1, 1.5 };
+        X a_ [] = { 0, 0.1, 0.1, 0.1, 0.2 };
+
+        for (int i = 0; i < 5; i++) {
+            if (i == 0 || i == 4) {
+                ensure(isnan(value<X, X>(u_[i], t_2.size(), t_2.data(), f_2.data())));
+            }
+            else {
+                x_ = fms::pwflat::value<X, X>(u_[i], t_2.size(), t_2.data(), f_2.data());
+                ensure(x_ == a_[i]);
+            }
+        }
+
+        for (int i = 0; i < 5; i++) {
+            if (i == 0) {
+                ensure(isnan(value<X, X>(u_[i], t_2.size(), t_2.data(), f_2.data(), 0.2)));
+            }
+            else {
+                x_ = fms::pwflat::value<X, X>(u_[i], t_2.size(), t_2.data(), f_2.data(), 0.2);
+                ensure(x_ == a_[i]);
+            }
+        }
+
+        for (int i = 0; i < 3; ++i)
+            ensure (f[i] == value(t[i], t.size(), t.data(), f.data()));
+    }
+    { // integral
+        X u;
+        u = -1;
+        ensure (isnan(integral(u, t.size(), t.data(), f.data())));
+        u = 4;
+        ensure (isnan(integral(u, t.size(), t.data(), f.data())));
+        u = 0;
+        ensure (0 == integral(u, t.size(), t.data(), f.data()));
+        u = 0.5;
+        ensure (.1*.5 == integral(u, t.size(), t.data(), f.data()));
+        u = 1;
+        ensure (.1 == integral(u, t.size(), t.data(), f.data()));
+        u = 1.5;
+        ensure (.1 + .2*.5 == integral(u, t.size(), t.data(), f.data()));
+        u = 2.5;
+        ensure (.1 + .2 + .3*.5 == integral(u, t.size(), t.data(), f.data()));
+        u = 3;
+        ensure (fabs(.1 + .2 + .3 - integral(u, t.size(), t.data(), f.data())) < 1e-10);
+        //		ensure (.1 + .2 + .3 != .6); 
+    }
+    { // discount
+        X u_[] = { -.5, 0, .5, 1, 1.5, 2, 2.5, 3, 3.5 };
         X f_[] = {0, 0, .05, .1, .2, .3, .45, .6, .7};
         for (int i = 0; i < 9; i++) {
             if (i == 0 || i == 8) {
@@ -489,6 +1634,361 @@ void test_fms_pwflat()
     }
 }
 
+template<class X>
+void test_fms_pwflat_discount_sweep()
+{
+    using namespace fms::pwflat;
+
+    // 200 knot curve out to 50 years
+    std::vector<X> t(200), f(200);
+    for (size_t i = 0; i < t.size(); ++i) {
+        t[i] = X(i + 1)/4;
+        f[i] = X(0.01) + X(i)/10000;
+    }
+    // 30 year quarterly cash flows, some on knots and some past the end of the curve
+    std::vector<X> u, c;
+    for (X u_ = X(0.1); u_ <= X(60); u_ += X(0.25)) {
+        u.push_back(u_);
+        c.push_back(X(0.01));
+    }
+    u.push_back(X(50));
+    c.push_back(X(1));
+    std::sort(u.begin(), u.end());
+
+    X _f = X(0.03);
+    X p = 0, d = 0;
+    for (size_t i = 0; i < u.size(); ++i) {
+        p += c[i]*discount(u[i], t.size(), t.data(), f.data(), _f);
+        d -= u[i]*c[i]*discount(u[i], t.size(), t.data(), f.data(), _f);
+    }
+    // bit-for-bit the same as discounting each cash flow
+    ensure (p == present_value(u.size(), u.data(), c.data(), t.size(), t.data(), f.data(), _f));
+    ensure (d == duration(u.size(), u.data(), c.data(), t.size(), t.data(), f.data(), _f));
+
+    curve<X,X> F(t.size(), t.data(), f.data(), _f);
+    fms::fixed_income::instrument<X,X> i(u.size(), u.data(), c.data());
+    ensure (p == F.present_value(i));
+    ensure (d == F.duration(i));
+
+    // unsorted cash flows fall back to discounting each cash flow
+    std::reverse(u.begin(), u.end());
+    std::reverse(c.begin(), c.end());
+    X p_ = present_value(u.size(), u.data(), c.data(), t.size(), t.data(), f.data(), _f);
+    ensure (fabs(p - p_) < 1e-12);
+    std::reverse(u.begin(), u.end());
+    std::reverse(c.begin(), c.end());
+
+    double secs;
+    secs = timer([&]() {
+        X p0 = 0;
+        for (size_t i = 0; i < u.size(); ++i) {
+            p0 += c[i]*discount(u[i], t.size(), t.data(), f.data(), _f);
+        }
+    }, 1000);
+    secs = secs;
+    secs = timer([&]() {
+        present_value(u.size(), u.data(), c.data(), t.size(), t.data(), f.data(), _f);
+    }, 1000);
+    secs = secs;
+}
+
+template<class X>
+void test_fms_pwflat_cached_curve()
+{
+    using namespace fms::pwflat;
+
+    std::vector<X> t(1000), f(1000);
+    for (size_t i = 0; i < t.size(); ++i) {
+        t[i] = X(i + 1)/100;
+        f[i] = X(0.01) + X(i % 7)/1000;
+    }
+    X _f = X(0.02);
+
+    cached_curve<X,X> c(t.size(), t.data(), f.data(), _f);
+    cached_curve<X,X> g(t.size(), t.data(), f.data(), _f, 100); // with grid
+    ensure (c.size() == t.size());
+
+    for (X u = X(-0.5); u < 12; u += X(0.013)) {
+        X v = value(u, t.size(), t.data(), f.data(), _f);
+        X I = integral(u, t.size(), t.data(), f.data(), _f);
+        X D = discount(u, t.size(), t.data(), f.data(), _f);
+        if (u < 0) {
+            ensure (isnan(c.value(u)) && isnan(c.integral(u)) && isnan(c.discount(u)));
+            continue;
+        }
+        ensure (v == c.value(u));
+        ensure (v == g.value(u));
+        ensure (I == c.integral(u));
+        ensure (I == g.integral(u));
+        ensure (fabs(D - c.discount(u)) <= 1e-14*D);
+        ensure (c.discount(u) == g.discount(u));
+        ensure (fabs(spot(u, t.size(), t.data(), f.data(), _f) - c.spot(u)) < 1e-14);
+    }
+    for (size_t i = 0; i < t.size(); ++i) {
+        ensure (c.index(t[i]) == i);
+        ensure (g.index(t[i]) == i);
+        ensure (c.discount(t[i]) == discount(t[i], t.size(), t.data(), f.data(), _f));
+    }
+    {
+        // conversion keeps the extrapolation
+        curve<X,X> c_(t.size(), t.data(), f.data(), _f);
+        cached_curve<X,X> d(c_);
+        ensure (d.extrapolate() == _f);
+        ensure (d.value(100) == _f);
+        cached_curve<X,X> e(c_, X(0.03), 100);
+        ensure (e.value(100) == X(0.03));
+
+        X nan = std::numeric_limits<X>::quiet_NaN();
+        X inf = std::numeric_limits<X>::infinity();
+        ensure (isnan(g.value(nan)) && isnan(g.integral(nan)) && isnan(g.discount(nan)));
+        ensure (g.value(inf) == _f && g.value(X(1e300)) == _f);
+        ensure (g.index(nan) == c.index(nan) && g.index(-inf) == 0);
+
+        // single knot at 0
+        X t0 = 0, f0 = X(0.01);
+        cached_curve<X,X> z(1, &t0, &f0, _f, 100);
+        ensure (z.index(0) == 0 && z.index(1) == 1);
+        ensure (z.value(0) == f0 && z.value(1) == _f);
+        ensure (z.discount(0) == 1);
+    }
+
+    double secs;
+    secs = timer([&]() {
+        for (X u = 0; u < 10; u += X(0.1)) {
+            discount(u, t.size(), t.data(), f.data(), _f);
+        }
+    }, 100);
+    secs = secs;
+    secs = timer([&]() {
+        for (X u = 0; u < 10; u += X(0.1)) {
+            c.discount(u);
+        }
+    }, 100);
+    secs = secs;
+    secs = timer([&]() {
+        for (X u = 0; u < 10; u += X(0.1)) {
+            g.discount(u);
+        }
+    }, 100);
+    secs = secs;
+}
+
+template<class X>
+void test_fms_pwflat_valid_curve()
+{
+    using namespace fms::pwflat;
+
+    {
+        X t[] = { 1, 2, 2 }, f[] = { .1, .2, .3 };
+        bool thrown = false;
+        try {
+            valid_curve<X,X>(3, t, f);
+        }
+        catch (...) {
+            thrown = true;
+        }
+        ensure (thrown);
+
+        t[2] = 3;
+        f[1] = std::numeric_limits<X>::quiet_NaN();
+        thrown = false;
+        try {
+            valid_curve<X,X>(3, t, f);
+        }
+        catch (...) {
+            thrown = true;
+        }
+        ensure (thrown);
+    }
+
+    for (size_t n : { 10, 100, 1000 }) {
+        std::vector<X> t(n), f(n);
+        for (size_t i = 0; i < n; ++i) {
+            t[i] = X(i + 1)*10/n;
+            f[i] = X(0.01) + X(i % 5)/1000;
+        }
+        X _f = X(0.02);
+        valid_curve<X,X> F(n, t.data(), f.data(), _f);
+
+        for (X u = 0; u < 12; u += X(0.1)) {
+            ensure (F.value(u) == value(u, n, t.data(), f.data(), _f));
+            ensure (F.integral(u) == integral(u, n, t.data(), f.data(), _f));
+            ensure (F.discount(u) == discount(u, n, t.data(), f.data(), _f));
+            ensure (F.spot(u) == spot(u, n, t.data(), f.data(), _f));
+        }
+
+        // 100000 discounts, checked vs unchecked: 0.12 vs 0.08 ms for n = 10,
+        // 1.2 vs 0.5 ms for n = 100, and 10 vs 4 ms for n = 1000
+        double secs;
+        X s = 0;
+        secs = timer([&]() {
+            for (X u = 0; u < 10; u += X(0.1)) {
+                s += discount(u, n, t.data(), f.data(), _f);
+            }
+        }, 1000);
+        secs = secs;
+        secs = timer([&]() {
+            for (X u = 0; u < 10; u += X(0.1)) {
+                s += F.discount(u);
+            }
+        }, 1000);
+        secs = secs;
+        ensure (s == s);
+    }
+}
+
+template<class X>
+void test_fms_pwflat_bundle()
+{
+    using namespace fms::pwflat;
+
+    size_t n = 40, K = 1000, m = 80;
+    std::vector<X> t(n), f(n);
+    for (size_t j = 0; j < n; ++j) {
+        t[j] = X(j + 1)/2;
+        f[j] = X(0.02) + X(j)/2000;
+    }
+    std::vector<X> u(m), c(m, X(0.01));
+    for (size_t i = 0; i < m; ++i) {
+        u[i] = X(i + 1)/4;
+    }
+    c.back() += 1;
+
+    // parallel bumps of the curve
+    bundle<X,X> B(n, t.data(), K);
+    std::vector<X> fk(n);
+    for (size_t k = 0; k < K; ++k) {
+        for (size_t j = 0; j < n; ++j) {
+            fk[j] = f[j] + (X(k) - K/2)/100000;
+        }
+        B.assign(k, fk.data(), fk.back());
+    }
+    ensure (B.scenarios() == K);
+
+    std::vector<X> D(K*m), pv(K);
+    B.discount(m, u.data(), D.data());
+    B.present_value(m, u.data(), c.data(), pv.data());
+    for (size_t k = 0; k < K; k += 37) {
+        for (size_t j = 0; j < n; ++j) {
+            fk[j] = B(j, k);
+        }
+        X pvk = present_value(m, u.data(), c.data(), n, t.data(), fk.data(), fk.back());
+        ensure (fabs(pv[k] - pvk) < 1e-14);
+        for (size_t i = 0; i < m; ++i) {
+            X Dki = discount(u[i], n, t.data(), fk.data(), fk.back());
+            ensure (fabs(D[k*m + i] - Dki) <= 4*std::numeric_limits<X>::epsilon()*Dki);
+        }
+    }
+
+    curve<X,X> F(n, t.data(), f.data(), X(0.03));
+    B.assign(0, F);
+    B.discount(m, u.data(), D.data());
+    ensure (fabs(D[m - 1] - F.discount(u[m - 1])) < 1e-15);
+
+    double secs;
+    secs = timer([&]() {
+        for (size_t k = 0; k < K; ++k) {
+            for (size_t j = 0; j < n; ++j) {
+                fk[j] = f[j] + (X(k) - K/2)/100000;
+            }
+            for (size_t i = 0; i < m; ++i) {
+                D[k*m + i] = discount(u[i], n, t.data(), fk.data(), fk.back());
+            }
+        }
+    });
+    secs = secs;
+    secs = timer([&]() {
+        B.discount(m, u.data(), D.data());
+    });
+    secs = secs;
+}
+
+template<class X>
+void test_fms_pwflat_static_curve()
+{
+    using namespace fms::pwflat;
+
+    constexpr static_curve c({ X(1), X(2), X(3) }, { X(.1), X(.2), X(.3) }, X(.4));
+    static_assert (c.size() == 3);
+    static_assert (c.value(0) == X(.1));
+    static_assert (c.value(1.5) == X(.2));
+    static_assert (c(4) == X(.4));
+    static_assert (c.integral(1) == X(.1));
+    static_assert (c.integral(X(2.5)) == X(.1) + X(.2) + X(.3)*X(.5));
+
+    constexpr auto c2 = static_curve<4,X,X>(X(.01)).push_back(1, X(.02)).push_back(2, X(.03));
+    static_assert (c2.size() == 2 && c2.capacity() == 4);
+    static_assert (c2.value(3) == X(.01));
+
+    // same as free functions
+    for (X u = 0; u < 4; u += X(0.25)) {
+        ensure (c.discount(u) == discount(u, c.size(), c.time(), c.rate(), c.extrapolate()));
+        ensure (c.spot(u) == spot(u, c.size(), c.time(), c.rate(), c.extrapolate()));
+    }
+    fms::fixed_income::zero<X,X> z(X(2.5));
+    ensure (c.present_value(z) == c.discount(X(2.5)));
+
+    bool thrown = false;
+    try {
+        static_curve<2,X,X>().push_back(1, 1).push_back(1, 1);
+    }
+    catch (...) {
+        thrown = true;
+    }
+    ensure (thrown);
+}
+
+template<class X>
+void test_fms_pwflat_key_rate_duration()
+{
+    using namespace fms::pwflat;
+    using fms::fixed_income::frequency;
+    using fms::fixed_income::interest_rate_swap;
+    using fms::fixed_income::zero;
+
+    std::vector<X> t{ .5, 1, 2, 3, 4, 5.1, 7 }, f{ .01, .012, .015, .02, .022, .023, .025 };
+    X _f = X(0.026);
+    curve<X,X> F(t.size(), t.data(), f.data(), _f);
+    interest_rate_swap<X,X> irs(X(10), X(0.02), frequency::quarterly);
+    zero<X,X> z(X(4));
+
+    auto d = F.key_rate_duration(irs);
+    ensure (d.size() == t.size() + 1);
+
+    X h = X(1e-6);
+    X sum = 0;
+    for (size_t j = 0; j <= t.size(); ++j) {
+        auto f_ = f, _f_ = f;
+        X fu = _f, fd = _f;
+        if (j < t.size()) {
+            f_[j] += h;
+            _f_[j] -= h;
+        }
+        else {
+            fu += h;
+            fd -= h;
+        }
+        X pu = curve<X,X>(t.size(), t.data(), f_.data(), fu).present_value(irs);
+        X pd = curve<X,X>(t.size(), t.data(), _f_.data(), fd).present_value(irs);
+        ensure (fabs(d[j] - (pu - pd)/(2*h)) < 1e-7);
+        sum += d[j];
+    }
+    ensure (fabs(sum - F.duration(irs)) < 1e-12);
+    ensure (fabs(d[t.size()] - partial_duration(irs.size(), irs.time(), irs.cash(), t.size(), t.data(), f.data(), _f)) < 1e-12);
+
+    // batch form accumulates
+    std::vector<interest_rate_swap<X,X>> book{ irs, irs };
+    auto d2 = F.key_rate_duration(book.begin(), book.end());
+    for (size_t j = 0; j <= t.size(); ++j) {
+        ensure (fabs(d2[j] - 2*d[j]) < 1e-12);
+    }
+
+    // zero coupon only sensitive to forwards before maturity
+    auto dz = F.key_rate_duration(z);
+    ensure (dz[5] == 0 && dz[6] == 0 && dz[7] == 0);
+    ensure (fabs(dz[0] + X(0.5)*F.discount(4)) < 1e-15);
+}
+
 template<class X>
 void test_fms_fixed_income_zero()
 {
@@ -623,6 +2123,925 @@ void test_fms_pwflat_bootstrap()
     assert (fhi < 3*std::numeric_limits<X>::epsilon());
 }
 
+// deposits, FRAs, and quarterly swaps with increasing maturities
+template<class X>
+std::vector<std::unique_ptr<fms::fixed_income::instrument<X,X>>> test_instruments(X step, X r = X(0.02))
+{
+    using namespace fms::fixed_income;
+    std::vector<std::unique_ptr<instrument<X,X>>> is;
+
+    for (X u = X(0.25); u <= 1; u += X(0.25)) {
+        is.emplace_back(new cash_deposit<X,X>(u, r));
+    }
+    for (X u = 1; u < 5; u += X(0.25)) {
+        is.emplace_back(new forward_rate_agreement<X,X>(u, u + X(0.25), r));
+    }
+    for (X u = 5 + step; u <= 50; u += step) {
+        is.emplace_back(new interest_rate_swap<X,X>(u, r, frequency::quarterly));
+    }
+
+    return is;
+}
+
+template<class X>
+void test_fms_pwflat_curve_builder()
+{
+    using fms::pwflat::bootstrap;
+    using fms::pwflat::curve;
+    using fms::pwflat::curve_builder;
+
+    // upward sloping reference curve
+    std::vector<X> t0, f0;
+    for (X u = 1; u <= 60; u += 1) {
+        t0.push_back(u);
+        f0.push_back(X(0.01) + u/1000);
+    }
+    curve<X,X> F0(t0.size(), t0.data(), f0.data());
+
+    for (X step : { X(1.5), X(0.5), X(0.25) }) {
+        auto is = test_instruments<X>(step);
+        std::vector<const fms::fixed_income::instrument<X,X>*> ip;
+        std::vector<X> p;
+        for (const auto& i : is) {
+            ip.push_back(i.get());
+            p.push_back(F0.present_value(*i));
+        }
+
+        curve_builder<X,X,X,X> b(ip.size(), ip.data(), p.data());
+        ensure (b.size() == is.size());
+        curve<X,X> F(b.size(), b.time(), b.rate());
+        for (size_t k = 0; k < is.size(); ++k) {
+            ensure (fabs(F.present_value(*is[k]) - p[k]) < 1e-12);
+        }
+
+        // same as one instrument at a time
+        std::vector<X> T, F_;
+        for (size_t k = 0; k < is.size(); ++k) {
+            auto [tk, fk] = bootstrap(p[k], *is[k], curve<X,X>(T.size(), T.data(), F_.data()));
+            T.push_back(tk);
+            F_.push_back(fk);
+            ensure (T[k] == b.time()[k]);
+            ensure (fabs(F_[k] - b.rate()[k]) < 1e-10);
+        }
+
+        double secs;
+        secs = timer([&]() {
+            T.clear();
+            F_.clear();
+            for (size_t k = 0; k < is.size(); ++k) {
+                auto [tk, fk] = bootstrap(p[k], *is[k], curve<X,X>(T.size(), T.data(), F_.data()));
+                T.push_back(tk);
+                F_.push_back(fk);
+            }
+        }, 10);
+        secs = secs;
+        secs = timer([&]() {
+            curve_builder<X,X,X,X>(ip.size(), ip.data(), p.data());
+        }, 10);
+        secs = secs;
+    }
+}
+
+template<class X>
+void test_fms_pwflat_curve_builder_update()
+{
+    using fms::pwflat::curve;
+    using fms::pwflat::curve_builder;
+
+    auto is = test_instruments<X>(X(0.5));
+    std::vector<const fms::fixed_income::instrument<X,X>*> ip;
+    std::vector<X> p;
+    curve<X,X> F0(X(0.02));
+    for (const auto& i : is) {
+        ip.push_back(i.get());
+        p.push_back(F0.present_value(*i));
+    }
+    curve_builder<X,X,X,X> b(ip.size(), ip.data(), p.data());
+
+    // replayed quote stream
+    std::default_random_engine dre;
+    std::uniform_int_distribution<size_t> k_(0, is.size() - 1);
+    std::normal_distribution<X> dp(0, X(0.0001));
+    std::vector<double> latency;
+    for (size_t n = 0; n < 1000; ++n) {
+        size_t k = k_(dre);
+        p[k] += dp(dre);
+        latency.push_back(timer([&b, k, &p]() { b.update(k, p[k]); }));
+    }
+    std::sort(latency.begin(), latency.end());
+    double p50 = latency[latency.size()/2];
+    double p99 = latency[latency.size()*99/100];
+    p50 = p50;
+    p99 = p99;
+
+    // same as building from scratch
+    double secs = timer([&]() { curve_builder<X,X,X,X>(ip.size(), ip.data(), p.data()); }, 100)/100;
+    secs = secs;
+    curve_builder<X,X,X,X> b_(ip.size(), ip.data(), p.data());
+    for (size_t k = 0; k < b.size(); ++k) {
+        ensure (b.time()[k] == b_.time()[k]);
+        ensure (b.rate()[k] == b_.rate()[k]);
+    }
+
+    // new deposit quote
+    fms::fixed_income::cash_deposit<X,X> cd(X(0.5), X(0.021));
+    b.update(1, cd, X(1));
+    curve<X,X> F(b.size(), b.time(), b.rate());
+    ensure (fabs(F.present_value(cd) - 1) < 1e-14);
+    ensure (fabs(F.present_value(*is[10]) - p[10]) < 1e-12);
+
+    // failed changes leave a consistent builder
+    {
+        fms::fixed_income::cash_deposit<X,X> d0(X(0.25), X(0.02)), d1(X(0.5), X(0.02)), d2(X(1), X(0.02));
+        const fms::fixed_income::instrument<X,X>* d[] = { &d0, &d1, &d2 };
+        X q[] = { X(1), X(1), X(1) };
+        curve_builder<X,X,X,X> c(2, d, q);
+
+        // maturity before the end of the curve
+        try {
+            c.add(d0, X(1));
+            ensure (false);
+        }
+        catch (const std::runtime_error&) { }
+        c.add(d2, X(1));
+        ensure (c.size() == 3);
+
+        // no forward reprices instrument 1
+        size_t k1 = 1;
+        X q1 = -1;
+        try {
+            c.update(1, &k1, d + 1, &q1);
+            ensure (false);
+        }
+        catch (const std::runtime_error&) { }
+        ensure (c.size() == 1);
+        // instrument 2 is past the end of the curve
+        try {
+            c.update(2, X(1));
+            ensure (false);
+        }
+        catch (const std::runtime_error&) { }
+        ensure (c.size() == 1);
+        c.update(1, X(1));
+
+        curve_builder<X,X,X,X> c_(3, d, q);
+        ensure (c.size() == 3);
+        for (size_t k = 0; k < c.size(); ++k) {
+            ensure (c.time()[k] == c_.time()[k]);
+            ensure (c.rate()[k] == c_.rate()[k]);
+        }
+    }
+}
+
+// derivatives in one backward sweep
+template<class X>
+void test_fms_adjoint()
+{
+    using fms::adjoint::tape;
+    using V = fms::adjoint::variable<X>;
+
+    X eps = std::numeric_limits<X>::epsilon();
+    auto close = [eps](X a, X b, X tol) { return fabs(a - b) <= tol*eps*(1 + fabs(b)); };
+
+    {
+        tape<X> tp;
+        X x0 = X(0.5), x1 = X(1.5);
+        V x[] = {V::independent(x0), V::independent(x1)};
+        V y = exp(x[0]*x[1]) + log(x[0])/x[1] - 2*sqrt(x[1]) + pow(x[0], X(3));
+        X dy[2];
+        gradient(y, 2, x, dy);
+        X e = std::exp(x0*x1);
+        ensure (close(dy[0], x1*e + 1/(x0*x1) + 3*x0*x0, 8));
+        ensure (close(dy[1], x0*e - std::log(x0)/(x1*x1) - 1/std::sqrt(x1), 8));
+
+        // Black greeks
+        X f = 100, sigma = X(0.2), k = 90, t = X(0.5);
+        V v[] = {V::independent(f), V::independent(sigma), V::independent(t)};
+        V p = black::value(v[0], v[1], k, v[2]);
+        auto g = black::risk(f, sigma, k, t);
+        X dp[3];
+        gradient(p, 3, v, dp);
+        ensure (close(p.value(), g.value, 16*k));
+        ensure (close(dp[0], g.delta, 16));
+        ensure (close(dp[1], g.vega, 64*k));
+        ensure (close(-dp[2], g.theta, 64*k));
+
+        // constants and pauses are not recorded
+        size_t n = tp.size();
+        V c = V(f)*V(sigma) + 1;
+        ensure (!c.recorded());
+        {
+            typename tape<X>::pause pause;
+            V z = x[0]*x[1];
+            ensure (!z.recorded());
+        }
+        ensure (tp.size() == n);
+    }
+    {
+        using namespace fms::fixed_income;
+        using fms::pwflat::curve_builder;
+
+        // deposit and semiannual swap quotes
+        X ud[] = {X(0.25), X(0.5)};
+        X us[] = {1, 2, 3, 5, 7, 10, 15, 20, 30};
+        size_t nd = 2, ns = 9, nq = nd + ns;
+        std::vector<X> r(nq);
+        for (size_t k = 0; k < nq; ++k) {
+            r[k] = X(0.02) + X(0.001)*k;
+        }
+
+        // off market swaps and zeros
+        std::vector<std::unique_ptr<instrument<X,X>>> book;
+        book.push_back(std::make_unique<interest_rate_swap<X,X>>(X(7), X(0.03), frequency::semiannual));
+        book.push_back(std::make_unique<interest_rate_swap<X,X>>(X(12), X(0.025), frequency::quarterly));
+        book.push_back(std::make_unique<zero<X,X>>(X(4.5), X(-3)));
+        book.push_back(std::make_unique<zero<X,X>>(X(25), X(2)));
+
+        // bootstrap the curve from quotes r and value the book
+        auto pv = [&]<class F>(const std::vector<F>& r) {
+            std::vector<std::unique_ptr<instrument<X,F>>> i;
+            std::vector<const instrument<X,F>*> ip;
+            std::vector<F> p;
+            for (size_t k = 0; k < nd; ++k) {
+                i.push_back(std::make_unique<cash_deposit<X,F>>(ud[k], r[k]));
+                p.push_back(F(1));
+            }
+            for (size_t k = 0; k < ns; ++k) {
+                i.push_back(std::make_unique<interest_rate_swap<X,F>>(us[k], r[nd + k], frequency::semiannual));
+                p.push_back(F(0));
+            }
+            for (const auto& ik : i) {
+                ip.push_back(ik.get());
+            }
+
+            curve_builder<X,F,X,F> b(ip.size(), ip.data(), p.data());
+            F s{ 0 };
+            for (const auto& j : book) {
+                s += fms::pwflat::present_value(j->size(), j->time(), j->cash(), b.size(), b.time(), b.rate());
+            }
+
+            return s;
+        };
+
+        tape<X> tp;
+        std::vector<V> q(nq);
+        std::vector<X> dq(nq);
+        auto adjoint = [&]() {
+            tp.clear();
+            for (size_t k = 0; k < nq; ++k) {
+                q[k] = V::independent(r[k]);
+            }
+            V s = pv(q);
+            gradient(s, nq, q.data(), dq.data());
+
+            return s;
+        };
+        X h = X(1e-6);
+        auto bump = [&](std::vector<X>& d) {
+            X s = pv(r);
+            for (size_t k = 0; k < nq; ++k) {
+                std::vector<X> r_(r);
+                r_[k] += h;
+                d[k] = (pv(r_) - s)/h;
+            }
+        };
+
+        V s = adjoint();
+        ensure (close(s.value(), pv(r), 16));
+        for (size_t k = 0; k < nq; ++k) {
+            std::vector<X> r_(r), _r(r);
+            r_[k] += h;
+            _r[k] -= h;
+            X d = (pv(r_) - pv(_r))/(2*h);
+            ensure (fabs(dq[k] - d) <= 1e-7*(1 + fabs(d)));
+        }
+        // a swap quote only moves the curve from its segment on
+        ensure (dq[nq - 1] != 0);
+
+        // one bootstrap as of the end of the curve agrees with the builder
+        {
+            std::vector<std::unique_ptr<instrument<X,V>>> i;
+            std::vector<X> t;
+            std::vector<V> f;
+            tp.clear();
+            for (size_t k = 0; k < nq; ++k) {
+                q[k] = V::independent(r[k]);
+                if (k < nd) {
+                    i.push_back(std::make_unique<cash_deposit<X,V>>(ud[k], q[k]));
+                }
+                else {
+                    i.push_back(std::make_unique<interest_rate_swap<X,V>>(us[k - nd], q[k], frequency::semiannual));
+                }
+                auto [tk, fk] = fms::pwflat::bootstrap<X,V,X,V>(V(k < nd ? 1 : 0), *i[k],
+                    fms::pwflat::curve<X,V>(t.size(), t.data(), f.data()));
+                t.push_back(tk);
+                f.push_back(fk);
+            }
+            V s_{ 0 };
+            for (const auto& j : book) {
+                s_ += fms::pwflat::present_value(j->size(), j->time(), j->cash(), t.size(), t.data(), f.data());
+            }
+            std::vector<X> dq_(nq);
+            gradient(s_, nq, q.data(), dq_.data());
+            ensure (fabs(s_.value() - s.value()) <= 1e-10);
+            for (size_t k = 0; k < nq; ++k) {
+                ensure (fabs(dq_[k] - dq[k]) <= 1e-8*(1 + fabs(dq[k])));
+            }
+        }
+
+        // all quote sensitivities by one adjoint pricing or nq + 1 pricings
+        size_t count = 100;
+        double secs;
+        std::vector<X> d(nq);
+        secs = timer([&]() { pv(r); }, count);
+        secs = secs;
+        secs = timer([&]() { adjoint(); }, count);
+        secs = secs;
+        secs = timer([&]() { bump(d); }, count);
+        secs = secs;
+        for (size_t k = 0; k < nq; ++k) {
+            ensure (fabs(d[k] - dq[k]) <= 1e-4*(1 + fabs(dq[k])));
+        }
+    }
+}
+
+template<class X>
+void test_fms_fixed_income_portfolio()
+{
+    using fms::fixed_income::instrument;
+    using fms::fixed_income::portfolio;
+    using fms::pwflat::curve;
+
+    std::vector<std::unique_ptr<instrument<X,X>>> is;
+    for (size_t n = 0; n < 50; ++n) {
+        auto is_ = test_instruments<X>(X(0.5), X(0.01) + X(n)/2000);
+        std::move(is_.begin(), is_.end(), std::back_inserter(is));
+    }
+
+    portfolio<X,X> P;
+    for (const auto& i : is) {
+        P.push_back(*i);
+    }
+    ensure (P.size() == is.size());
+    for (size_t k = 0; k < P.size(); ++k) {
+        ensure (P[k] == *is[k]);
+    }
+
+    // unmanaged views
+    {
+        portfolio<X,X> P_(P.size(), P.offset(), P.time(), P.cash());
+        ensure (P_.size() == P.size());
+        ensure (P_.cash_flows() == P.cash_flows());
+        ensure (P_[1] == *is[1]);
+
+        portfolio<X,X> E(0, nullptr, nullptr, nullptr);
+        ensure (E.size() == 0);
+        ensure (E.cash_flows() == 0);
+        try {
+            portfolio<X,X> E_(1, nullptr, nullptr, nullptr);
+            ensure (false);
+        }
+        catch (const std::runtime_error&) { }
+    }
+
+    std::vector<X> t, f;
+    for (X u = X(0.25); u <= 40; u += X(0.25)) {
+        t.push_back(u);
+        f.push_back(X(0.01) + u/1000);
+    }
+    curve<X,X> F(t.size(), t.data(), f.data(), X(0.05));
+
+    std::vector<X> pv(P.size());
+    present_value(P, F, pv.data());
+    for (size_t k = 0; k < P.size(); ++k) {
+        ensure (pv[k] == F.present_value(*is[k]));
+        ensure (pv[k] == F.present_value(P[k]));
+    }
+
+    std::vector<X> dur(P.size());
+    duration(P, F, dur.data());
+    for (size_t k = 0; k < P.size(); ++k) {
+        ensure (dur[k] == F.duration(*is[k]));
+    }
+
+    double secs;
+    secs = timer([&]() {
+        for (size_t k = 0; k < is.size(); ++k) {
+            pv[k] = F.present_value(*is[k]);
+        }
+    });
+    secs = secs;
+    secs = timer([&]() {
+        present_value(P, F, pv.data());
+    });
+    secs = secs;
+}
+
+template<class X>
+void test_fms_pwflat_parallel()
+{
+    using fms::fixed_income::instrument;
+    using fms::fixed_income::portfolio;
+    using fms::pwflat::curve;
+
+    portfolio<X,X> P;
+    for (size_t n = 0; n < 200; ++n) {
+        for (const auto& i : test_instruments<X>(X(0.5), X(0.01) + X(n)/10000)) {
+            P.push_back(*i);
+        }
+    }
+
+    std::vector<X> t, f;
+    for (X u = X(0.25); u <= 40; u += X(0.25)) {
+        t.push_back(u);
+        f.push_back(X(0.01) + u/1000);
+    }
+    curve<X,X> F(t.size(), t.data(), f.data(), X(0.05));
+
+    std::vector<X> pv1(P.size()), dur1(P.size());
+    fms::pwflat::present_value(P, F, pv1.data());
+    fms::pwflat::duration(P, F, dur1.data());
+
+    // same values and totals for any number of threads
+    std::vector<X> pv(P.size()), dur(P.size());
+    X PV = fms::pwflat::parallel::present_value(P, F, pv.data(), 1, 100);
+    X DUR = fms::pwflat::parallel::duration(P, F, dur.data(), 1, 100);
+    for (size_t threads : {2, 3, 8, 64}) {
+        ensure (PV == fms::pwflat::parallel::present_value(P, F, pv.data(), threads, 100));
+        ensure (pv == pv1);
+        ensure (DUR == fms::pwflat::parallel::duration(P, F, dur.data(), threads, 100));
+        ensure (dur == dur1);
+    }
+    X PV_{ 0 };
+    for (const auto& p : pv1) {
+        PV_ += p;
+    }
+    ensure (fabs(PV - PV_) <= 1e-12*P.size());
+
+    // bad curve
+    X t_[] = { 2, 1 };
+    ensure (std::isnan(fms::pwflat::parallel::present_value(P, 2, t_, f.data(), pv.data(), X(0.05), 4)));
+    ensure (std::isnan(pv[0]));
+
+    // scaling
+    double secs;
+    for (size_t threads = 1; threads <= 64; threads *= 2) {
+        secs = timer([&]() {
+            PV = fms::pwflat::parallel::present_value(P, F, pv.data(), threads);
+        });
+        secs = secs;
+    }
+}
+
+template<class X>
+void test_fms_pwflat_swap()
+{
+    using fms::fixed_income::frequency;
+    using fms::fixed_income::interest_rate_swap;
+    using fms::fixed_income::swap_schedule_cache;
+    using fms::pwflat::curve;
+
+    swap_schedule_cache<X> cache;
+    auto s = cache.get(X(10), frequency::quarterly);
+    ensure (s == cache.get(X(10), frequency::quarterly));
+    ensure (s != cache.get(X(10), frequency::semiannual));
+    ensure (cache.size() == 2);
+
+    // same cash flows as constructing the schedule
+    interest_rate_swap<X,X> irs(X(10), X(0.02), frequency::quarterly);
+    interest_rate_swap<X,X> irs_(s, X(0.02));
+    ensure (irs == irs_);
+    ensure (irs_.time() == s->time());
+
+    std::vector<X> t, f;
+    for (X u = X(0.25); u <= 20; u += X(0.25)) {
+        t.push_back(u);
+        f.push_back(X(0.01) + u/1000);
+    }
+    curve<X,X> F(t.size(), t.data(), f.data(), X(0.03));
+
+    // book of swaps sharing 2*30 schedules
+    std::default_random_engine dre;
+    std::uniform_int_distribution<int> tenor(1, 30);
+    std::uniform_real_distribution<X> coupon(X(0.01), X(0.05));
+    std::vector<interest_rate_swap<X,X>> book;
+    for (size_t k = 0; k < 50000; ++k) {
+        frequency q = k % 2 ? frequency::quarterly : frequency::semiannual;
+        book.emplace_back(cache.get(X(tenor(dre)), q), coupon(dre));
+    }
+    ensure (cache.size() <= 2 + 60);
+
+    std::vector<X> pv(book.size());
+    fms::pwflat::present_value(book.size(), book.data(), F, pv.data());
+    for (size_t k = 0; k < book.size(); ++k) {
+        ensure (fabs(pv[k] - F.present_value(book[k])) < 1e-14);
+    }
+
+    double secs;
+    secs = timer([&]() {
+        for (size_t k = 0; k < book.size(); ++k) {
+            pv[k] = F.present_value(book[k]);
+        }
+    });
+    secs = secs;
+    secs = timer([&]() {
+        fms::pwflat::present_value(book.size(), book.data(), F, pv.data());
+    });
+    secs = secs;
+}
+
+template<class X>
+void test_fms_pwflat_par_coupons()
+{
+    using fms::fixed_income::frequency;
+    using fms::fixed_income::interest_rate_swap;
+    using fms::fixed_income::par_coupon;
+    using fms::pwflat::curve;
+
+    std::vector<X> t, f;
+    for (X u = X(0.25); u <= 40; u += X(0.25)) {
+        t.push_back(u);
+        f.push_back(X(0.01) + u/1000);
+    }
+    curve<X,X> F(t.size(), t.data(), f.data(), X(0.05));
+
+    std::vector<X> u(50), r(50);
+    for (size_t k = 0; k < u.size(); ++k) {
+        u[k] = X(k + 1);
+    }
+    fms::pwflat::par_coupons(u.size(), u.data(), frequency::semiannual, F, r.data());
+
+    std::function<X(X)> D = [&F](X u_) { return F.discount(u_); };
+    for (size_t k = 0; k < u.size(); ++k) {
+        interest_rate_swap<X,X> irs(u[k], r[k], frequency::semiannual);
+        ensure (fabs(r[k] - par_coupon(irs, D)) < 1e-14);
+        ensure (fabs(F.present_value(irs)) < 1e-14);
+    }
+
+    double secs;
+    secs = timer([&]() {
+        for (size_t k = 0; k < u.size(); ++k) {
+            r[k] = par_coupon(interest_rate_swap<X,X>(u[k], X(0), frequency::semiannual), D);
+        }
+    });
+    secs = secs;
+    secs = timer([&]() {
+        fms::pwflat::par_coupons(u.size(), u.data(), frequency::semiannual, F, r.data());
+    });
+    secs = secs;
+}
+
+template<class X>
+void test_fms_fixed_income_ladder()
+{
+    using fms::fixed_income::frequency;
+    using fms::fixed_income::interest_rate_swap;
+    using fms::fixed_income::ladder;
+    using fms::fixed_income::portfolio;
+    using fms::pwflat::bundle;
+    using fms::pwflat::curve;
+
+    {
+        std::vector<interest_rate_swap<X,X>> book{
+            interest_rate_swap<X,X>(X(1), X(0.01), frequency::quarterly),
+            interest_rate_swap<X,X>(X(2), X(0.02), frequency::semiannual),
+        };
+        ladder<X,X> L(book.begin(), book.end());
+        ensure (L.cash_flows() == 5 + 5);
+        ensure (L.size() == 7);
+        ensure (L.time()[0] == 0 && L.cash()[0] == -2);
+        ensure (L.time()[2] == X(0.5) && L.cash()[2] == X(0.01)/4 + X(0.02)/2);
+    }
+
+    portfolio<X,X> P;
+    for (size_t n = 0; n < 100; ++n) {
+        for (const auto& i : test_instruments<X>(X(0.25), X(0.01) + X(n)/10000)) {
+            P.push_back(*i);
+        }
+    }
+    ladder<X,X> L(P);
+    ensure (L.size() < L.cash_flows()/100);
+    ensure (std::is_sorted(L.time(), L.time() + L.size()));
+
+    std::vector<X> t, f;
+    for (X u = X(0.25); u <= 40; u += X(0.25)) {
+        t.push_back(u);
+        f.push_back(X(0.01) + u/1000);
+    }
+
+    // parallel shifted scenarios
+    size_t K = 64;
+    bundle<X,X> B(t.size(), t.data(), K);
+    for (size_t k = 0; k < K; ++k) {
+        auto f_ = f;
+        for (auto& fj : f_) {
+            fj += X(k)/10000;
+        }
+        B.assign(k, f_.data(), X(0.05));
+    }
+
+    std::vector<X> pv(P.size()), PV(K), PV_(K);
+    B.present_value(L, PV.data());
+    for (size_t k = 0; k < K; ++k) {
+        std::vector<X> fk(t.size());
+        for (size_t j = 0; j < t.size(); ++j) {
+            fk[j] = B(j, k);
+        }
+        curve<X,X> F(t.size(), t.data(), fk.data(), X(0.05));
+        fms::pwflat::present_value(P, F, pv.data());
+        PV_[k] = 0;
+        for (const auto& p : pv) {
+            PV_[k] += p;
+        }
+        ensure (fabs(PV[k] - PV_[k]) < 1e-13*fabs(PV_[k]));
+        ensure (fabs(F.present_value(L) - PV_[k]) < 1e-13*fabs(PV_[k]));
+    }
+
+    // one discount per cash flow and scenario
+    double secs;
+    secs = timer([&]() {
+        std::fill(PV_.begin(), PV_.end(), X(0));
+        for (size_t k = 0; k < P.size(); ++k) {
+            B.present_value(P[k], pv.data());
+            fms::simd::axpy(K, X(1), pv.data(), PV_.data());
+        }
+    });
+    secs = secs;
+
+    // one discount per distinct time and scenario
+    secs = timer([&]() {
+        B.present_value(L, PV.data());
+    });
+    secs = secs;
+}
+
+template<class X>
+void test_fms_binary()
+{
+    using fms::binary::mapped_file;
+    using fms::fixed_income::portfolio;
+    using fms::pwflat::curve;
+
+    auto tmp = std::filesystem::temp_directory_path();
+    std::string curve_file = (tmp / "fms_curve.bin").string();
+    std::string book_file = (tmp / "fms_book.bin").string();
+    std::string text_file = (tmp / "fms_book.txt").string();
+
+    std::vector<X> t, f;
+    for (X u = X(0.25); u <= 40; u += X(0.25)) {
+        t.push_back(u);
+        f.push_back(X(0.01) + u/1000);
+    }
+    curve<X,X> F(t.size(), t.data(), f.data(), X(0.05));
+
+    portfolio<X,X> P;
+    for (size_t n = 0; n < 20; ++n) {
+        for (const auto& i : test_instruments<X>(X(0.25), X(0.01) + X(n)/10000)) {
+            P.push_back(*i);
+        }
+    }
+
+    fms::binary::write(curve_file.c_str(), F);
+    fms::binary::write(book_file.c_str(), P);
+    {
+        mapped_file mf(curve_file.c_str());
+        auto F_ = mf.curve<X,X>();
+        ensure (F_ == F);
+        ensure (F_.extrapolate() == F.extrapolate());
+        ensure (F_.discount(X(45)) == F.discount(X(45)));
+
+        // wrong type
+        bool thrown = false;
+        try {
+            mf.portfolio<X,X>();
+        }
+        catch (...) {
+            thrown = true;
+        }
+        ensure (thrown);
+    }
+    {
+        mapped_file mb(book_file.c_str());
+        auto P_ = mb.portfolio<X,X>();
+        ensure (P_.size() == P.size());
+        ensure (P_.cash_flows() == P.cash_flows());
+        for (size_t k = 0; k < P.size(); ++k) {
+            ensure (P_[k] == P[k]);
+        }
+
+        // no copy
+        ensure (reinterpret_cast<const char*>(P_.time()) > mb.data());
+        ensure (reinterpret_cast<const char*>(P_.time()) < mb.data() + mb.size());
+
+        std::vector<X> pv(P.size()), pv_(P.size());
+        present_value(P, F, pv.data());
+        present_value(P_, F, pv_.data());
+        ensure (pv == pv_);
+    }
+
+    // corrupt headers and offsets are rejected
+    {
+        std::string bad_file = (tmp / "fms_bad.bin").string();
+        std::vector<char> book(std::filesystem::file_size(book_file));
+        std::ifstream(book_file, std::ios::binary).read(book.data(), book.size());
+        auto rejected = [&](size_t at, uint64_t value) {
+            std::vector<char> bad(book);
+            std::memcpy(bad.data() + at, &value, sizeof(value));
+            std::ofstream(bad_file, std::ios::binary).write(bad.data(), bad.size());
+            mapped_file mb(bad_file.c_str());
+            bool thrown = false;
+            try {
+                mb.portfolio<X,X>();
+            }
+            catch (...) {
+                thrown = true;
+            }
+            return thrown;
+        };
+        size_t o = offsetof(fms::binary::header, n);
+        size_t o_ = sizeof(fms::binary::header);
+        ensure (rejected(o, UINT64_MAX)); // n + 1 overflows
+        ensure (rejected(o, UINT64_MAX/8)); // n*sizeof(size_t) overflows
+        ensure (rejected(o + 8, UINT64_MAX/8 + 1)); // m*sizeof(X) overflows
+        ensure (rejected(o_, 1)); // first offset not 0
+        ensure (rejected(o_ + 8, P.cash_flows() + 1)); // offsets decrease
+        std::filesystem::remove(bad_file);
+    }
+
+    // text format: number of cash flows followed by times and cash flows of each instrument
+    {
+        std::ofstream os(text_file);
+        os.precision(17);
+        for (size_t k = 0; k < P.size(); ++k) {
+            auto i = P[k];
+            os << i.size();
+            for (size_t j = 0; j < i.size(); ++j) {
+                os << ' ' << i.time()[j] << ' ' << i.cash()[j];
+            }
+            os << '\n';
+        }
+    }
+
+    double secs;
+    secs = timer([&]() {
+        std::ifstream is(text_file);
+        portfolio<X,X> P_;
+        size_t m;
+        std::vector<X> u, c;
+        while (is >> m) {
+            u.resize(m);
+            c.resize(m);
+            for (size_t j = 0; j < m; ++j) {
+                is >> u[j] >> c[j];
+            }
+            P_.push_back(fms::fixed_income::instrument<X,X>(m, u.data(), c.data()));
+        }
+        ensure (P_.cash_flows() == P.cash_flows());
+    });
+    secs = secs;
+    secs = timer([&]() {
+        mapped_file mb(book_file.c_str());
+        auto P_ = mb.portfolio<X,X>();
+        ensure (P_.cash_flows() == P.cash_flows());
+    });
+    secs = secs;
+
+    std::filesystem::remove(curve_file);
+    std::filesystem::remove(book_file);
+    std::filesystem::remove(text_file);
+}
+
+template<class X>
+void test_fms_quote()
+{
+    using fms::pwflat::curve;
+    using fms::pwflat::curve_builder;
+    using fms::quote::quote;
+
+    {
+        quote q;
+        ensure (fms::quote::parse("D 0.5 0.02", q));
+        ensure (q.type == 'D' && q.u == 0.5 && q.r == 0.02);
+        ensure (fms::quote::parse(" F 1 1.25 0.021", q));
+        ensure (q.type == 'F' && q.u == 1 && q.v == 1.25 && q.r == 0.021);
+        ensure (fms::quote::parse("S 10 4 0.025", q));
+        ensure (q.type == 'S' && q.u == 10 && q.v == 4 && q.r == 0.025);
+        ensure (!fms::quote::parse("X 1 2", q));
+        ensure (!fms::quote::parse("D 1", q));
+        ensure (!fms::quote::parse("F 2 1 0.02", q));
+        ensure (!fms::quote::parse("S 10 3 0.025", q)); // not a frequency
+    }
+
+    // FRA at the par forward rate has zero value
+    {
+        curve<X,X> F(X(0.03));
+        X r = (exp(X(0.03)*X(0.25)) - 1)/X(0.25);
+        fms::fixed_income::forward_rate_agreement<X,X> fra(X(1), X(1.25), r);
+        ensure (fabs(F.present_value(fra)) < 1e-15);
+    }
+
+    // curve definition
+    std::vector<quote> q0;
+    for (X u = X(0.25); u <= 1; u += X(0.25)) {
+        q0.push_back(quote{ 'D', u, 0, 0.02, 0 });
+    }
+    for (X u = 1; u < 5; u += X(0.25)) {
+        q0.push_back(quote{ 'F', u, u + X(0.25), 0.02, 0 });
+    }
+    for (X u = 6; u <= 30; u += 1) {
+        q0.push_back(quote{ 'S', u, 4, 0.02, 0 });
+    }
+
+    // recorded feed
+    std::stringstream feed;
+    fms::quote::simulate(feed, q0.size(), q0.data(), 10000);
+    std::string recorded = feed.str();
+
+    size_t published = 0;
+    fms::quote::pipeline<X,X> P(q0.size(), q0.data(), [&published](const auto&) { ++published; });
+    std::thread producer([&P, &feed]() {
+        fms::quote::replay(feed, [&P](const char* line) { P.post(line); });
+        P.close();
+    });
+    P.run();
+    producer.join();
+
+    ensure (P.size() == 10000);
+    ensure (P.unknown() == 0);
+    ensure (P.rebuilds() == published);
+    ensure (P.rebuilds() <= P.size());
+    double p50 = P.percentile(0.5);
+    double p99 = P.percentile(0.99);
+    ensure (p50 <= p99);
+
+    // same curve as building from the last quote of each instrument
+    std::istringstream is(recorded);
+    std::string line;
+    while (std::getline(is, line)) {
+        quote q;
+        ensure (fms::quote::parse(line.c_str(), q));
+        for (auto& q_ : q0) {
+            if (q_.key() == q.key()) {
+                q_.r = q.r;
+            }
+        }
+    }
+    std::vector<std::unique_ptr<fms::fixed_income::instrument<X,X>>> i;
+    std::vector<const fms::fixed_income::instrument<X,X>*> ip;
+    std::vector<X> p;
+    for (const auto& q : q0) {
+        i.push_back(fms::quote::instrument<X,X>(q));
+        ip.push_back(i.back().get());
+        p.push_back(fms::quote::price<X>(q));
+    }
+    curve_builder<X,X,X,X> b(ip.size(), ip.data(), p.data());
+    const auto& b_ = P.curve();
+    ensure (b_.size() == b.size());
+    for (size_t k = 0; k < b.size(); ++k) {
+        ensure (b_.time()[k] == b.time()[k]);
+        ensure (b_.rate()[k] == b.rate()[k]);
+    }
+
+    // a quote the curve can not be built from is dropped and the consumer keeps going
+    {
+        fms::quote::pipeline<X,X> P_(q0.size(), q0.data());
+        ensure (P_.post("D 0.25 -10")); // negative cash flow
+        P_.poll();
+        ensure (P_.rejected() == 1);
+        ensure (P_.rebuilds() == 0);
+        ensure (P_.post("D 0.25 0.03"));
+        P_.close();
+        P_.run();
+        ensure (P_.rebuilds() == 1);
+        ensure (P_.curve().instrument(0).cash()[0] == 1 + X(0.03)*X(0.25));
+        ensure (P_.curve().instrument(1).cash()[0] == 1 + X(q0[1].r)*X(q0[1].u));
+    }
+    // deposits and FRAs are solved in closed form
+    {
+        size_t n = std::count_if(q0.begin(), q0.end(), [](const quote& q) { return q.type != 'S'; });
+        size_t published_ = 0;
+        fms::quote::pipeline<X,X> P_(n, q0.data(), [&published_](const auto&) { ++published_; });
+        ensure (P_.post("D 0.25 -10"));
+        P_.poll();
+        ensure (P_.rejected() == 1);
+        ensure (P_.rebuilds() == 0 && published_ == 0);
+        ensure (P_.curve().size() == n);
+        for (size_t k = 0; k < n; ++k) {
+            ensure (std::isfinite(P_.curve().rate()[k]));
+        }
+    }
+    // latencies of the last L quotes
+    {
+        fms::quote::pipeline<X,X,64,16> P_(q0.size(), q0.data());
+        for (size_t k = 0; k < 100; ++k) {
+            ensure (P_.post(k % 2 ? "D 0.25 0.03" : "D 0.25 0.02"));
+            P_.poll();
+        }
+        ensure (P_.size() == 100 && P_.rebuilds() == 100);
+        ensure (P_.percentile(0) <= P_.percentile(1));
+    }
+}
+
 template<class X>
 void test_fms_brownian()
 {
@@ -793,6 +3212,13 @@ int main()
     test_fms_correlation<double>();
     test_fms_brownian<double>();
     test_fms_analytic<double>();
+    test_fms_analytic_fixed<double>();
+    test_fms_analytic_fixed<float>();
+    test_fms_analytic_functions<double>();
+    test_fms_analytic_product<double>();
+    test_fms_analytic_product<float>();
+    test_fms_analytic_lazy<double>();
+    test_fms_jet<double>();
 
     test_fms_poly_Hermite<double>();
     test_fms_poly_Hermite<float>();
@@ -800,6 +3226,8 @@ int main()
     test_fms_poly_Bell<double>();
     test_fms_poly_Bell<float>();
 
+    test_fms_prob_normal<double>();
+    test_fms_prob_normal<float>();
     test_fms_prob_njr<double>();
 
     test_fms_root1d_newton<double>();
@@ -809,11 +3237,27 @@ int main()
     test_fms_black<float>();
 
     test_fms_pwflat<double>();
+    test_fms_pwflat_discount_sweep<double>();
+    test_fms_pwflat_cached_curve<double>();
+    test_fms_pwflat_valid_curve<double>();
+    test_fms_pwflat_bundle<double>();
+    test_fms_pwflat_static_curve<double>();
+    test_fms_pwflat_key_rate_duration<double>();
     //test_fms_pwflat<float>();
 
     test_fms_fixed_income_zero<double>();
 
     test_fms_pwflat_bootstrap<double>();
+    test_fms_pwflat_curve_builder<double>();
+    test_fms_pwflat_curve_builder_update<double>();
+    test_fms_adjoint<double>();
+    test_fms_fixed_income_portfolio<double>();
+    test_fms_pwflat_parallel<double>();
+    test_fms_pwflat_swap<double>();
+    test_fms_pwflat_par_coupons<double>();
+    test_fms_fixed_income_ladder<double>();
+    test_fms_binary<double>();
+    test_fms_quote<double>();
 
     test_fms_ho_lee<double>();
 
@@ -0,0 +1,433 @@
+// fms_adjoint.h - reverse mode automatic differentiation
+// Operations on variables are recorded on the active tape. Each node has edges to its arguments
+// weighted by the partial derivatives, so one backward sweep from y gives dy/dx for every x.
+// Roots found by fms::root1d::newton are recorded as a single node using the implicit
+// function theorem instead of one node per iteration.
+#pragma once
+#include <cmath>
+#include <compare>
+#include <functional>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "fms_prob.h"
+#include "fms_root1d_newton.h"
+#include "../xll12/xll/ensure.h"
+
+namespace fms::adjoint {
+
+    // Append only storage in blocks of B elements that are kept when cleared.
+    template<class T, size_t B = 4096>
+    class arena {
+        std::vector<std::unique_ptr<T[]>> b;
+        size_t n;
+    public:
+        arena()
+            : n(0)
+        { }
+        arena(const arena&) = delete;
+        arena& operator=(const arena&) = delete;
+
+        size_t size() const
+        {
+            return n;
+        }
+        size_t capacity() const
+        {
+            return b.size()*B;
+        }
+        void clear()
+        {
+            n = 0;
+        }
+        T& operator[](size_t i)
+        {
+            return b[i/B][i%B];
+        }
+        const T& operator[](size_t i) const
+        {
+            return b[i/B][i%B];
+        }
+        // index of t
+        size_t push_back(const T& t)
+        {
+            if (n == capacity()) {
+                b.push_back(std::make_unique<T[]>(B));
+            }
+            (*this)[n] = t;
+
+            return n++;
+        }
+    };
+
+    // Nodes in the order they were recorded. Constructing a tape makes it active
+    // for the thread until it is destroyed.
+    template<class X = double>
+    class tape {
+    public:
+        static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+        struct edge {
+            size_t i; // argument node
+            X d;      // partial derivative with respect to the argument
+        };
+    private:
+        arena<size_t> node; // first edge of each node
+        arena<edge> edges;
+        tape* prev;
+        bool paused;
+    public:
+        tape()
+            : prev(active()), paused(false)
+        {
+            active() = this;
+        }
+        tape(const tape&) = delete;
+        tape& operator=(const tape&) = delete;
+        ~tape()
+        {
+            active() = prev;
+        }
+
+        static tape*& active()
+        {
+            thread_local tape* t = nullptr;
+
+            return t;
+        }
+
+        // Operations are not recorded while a pause is in scope.
+        class pause {
+            tape* t;
+            bool p;
+        public:
+            pause()
+                : t(active()), p(t && t->paused)
+            {
+                if (t) {
+                    t->paused = true;
+                }
+            }
+            pause(const pause&) = delete;
+            pause& operator=(const pause&) = delete;
+            ~pause()
+            {
+                if (t) {
+                    t->paused = p;
+                }
+            }
+        };
+
+        size_t size() const
+        {
+            return node.size();
+        }
+        void clear()
+        {
+            node.clear();
+            edges.clear();
+        }
+
+        // New node with edges to recorded arguments, npos if paused.
+        size_t record(std::initializer_list<edge> e)
+        {
+            if (paused) {
+                return npos;
+            }
+
+            size_t k = node.push_back(edges.size());
+            for (const auto& ei : e) {
+                if (ei.i != npos) {
+                    edges.push_back(ei);
+                }
+            }
+
+            return k;
+        }
+
+        // a[k] = dy/dx_k for nodes k <= y
+        void backward(size_t y, std::vector<X>& a) const
+        {
+            a.assign(y + 1, X(0));
+            a[y] = 1;
+
+            for (size_t k = y + 1; k-- > 0; ) {
+                if (a[k] != 0) {
+                    size_t e1 = k + 1 < node.size() ? node[k + 1] : edges.size();
+                    for (size_t e = node[k]; e < e1; ++e) {
+                        a[edges[e].i] += edges[e].d*a[k];
+                    }
+                }
+            }
+        }
+    };
+
+    // Scalar recording its operations on the active tape.
+    template<class X = double>
+    class variable {
+        static constexpr size_t npos = tape<X>::npos;
+
+        X x;
+        size_t i; // node or npos for constants
+
+        variable(X x, size_t i)
+            : x(x), i(i)
+        { }
+        static variable unary(X y, const variable& a, X da)
+        {
+            tape<X>* t = tape<X>::active();
+
+            return variable(y, a.i == npos || !t ? npos : t->record({{a.i, da}}));
+        }
+        static variable binary(X y, const variable& a, X da, const variable& b, X db)
+        {
+            tape<X>* t = tape<X>::active();
+
+            return variable(y, (a.i == npos && b.i == npos) || !t ? npos : t->record({{a.i, da}, {b.i, db}}));
+        }
+    public:
+        // constant
+        constexpr variable(X x = 0)
+            : x(x), i(npos)
+        { }
+        // independent variable on the active tape
+        static variable independent(X x)
+        {
+            tape<X>* t = tape<X>::active();
+            ensure (t);
+
+            return variable(x, t->record({}));
+        }
+        // value x0 with derivative d with respect to y, e.g., x = g(y) for an implicit function
+        static variable implicit(X x0, const variable& y, X d)
+        {
+            return unary(x0, y, d);
+        }
+
+        X value() const
+        {
+            return x;
+        }
+        // node on the tape
+        size_t index() const
+        {
+            return i;
+        }
+        bool recorded() const
+        {
+            return i != npos;
+        }
+
+        // dy/dx[k] for k < n in one backward sweep
+        friend void gradient(const variable& y, size_t n, const variable* x, X* dx)
+        {
+            std::vector<X> a;
+
+            if (y.recorded()) {
+                tape<X>::active()->backward(y.i, a);
+            }
+            for (size_t k = 0; k < n; ++k) {
+                dx[k] = x[k].i < a.size() ? a[x[k].i] : X(0);
+            }
+        }
+
+        // compare values
+        friend bool operator==(const variable& a, const variable& b)
+        {
+            return a.x == b.x;
+        }
+        friend auto operator<=>(const variable& a, const variable& b)
+        {
+            return a.x <=> b.x;
+        }
+
+        variable operator-() const
+        {
+            return unary(-x, *this, X(-1));
+        }
+
+        friend variable operator+(const variable& a, const variable& b)
+        {
+            return binary(a.x + b.x, a, X(1), b, X(1));
+        }
+        friend variable operator-(const variable& a, const variable& b)
+        {
+            return binary(a.x - b.x, a, X(1), b, X(-1));
+        }
+        friend variable operator*(const variable& a, const variable& b)
+        {
+            return binary(a.x*b.x, a, b.x, b, a.x);
+        }
+        friend variable operator/(const variable& a, const variable& b)
+        {
+            X y = a.x/b.x;
+
+            return binary(y, a, 1/b.x, b, -y/b.x);
+        }
+
+        // scalars
+        friend variable operator+(const variable& a, X b)
+        {
+            return unary(a.x + b, a, X(1));
+        }
+        friend variable operator+(X a, const variable& b)
+        {
+            return unary(a + b.x, b, X(1));
+        }
+        friend variable operator-(const variable& a, X b)
+        {
+            return unary(a.x - b, a, X(1));
+        }
+        friend variable operator-(X a, const variable& b)
+        {
+            return unary(a - b.x, b, X(-1));
+        }
+        friend variable operator*(const variable& a, X b)
+        {
+            return unary(a.x*b, a, b);
+        }
+        friend variable operator*(X a, const variable& b)
+        {
+            return unary(a*b.x, b, a);
+        }
+        friend variable operator/(const variable& a, X b)
+        {
+            return unary(a.x/b, a, 1/b);
+        }
+        friend variable operator/(X a, const variable& b)
+        {
+            X y = a/b.x;
+
+            return unary(y, b, -y/b.x);
+        }
+
+        variable& operator+=(const variable& b)
+        {
+            return *this = *this + b;
+        }
+        variable& operator-=(const variable& b)
+        {
+            return *this = *this - b;
+        }
+        variable& operator*=(const variable& b)
+        {
+            return *this = *this*b;
+        }
+        variable& operator/=(const variable& b)
+        {
+            return *this = *this/b;
+        }
+        variable& operator+=(X b)
+        {
+            return *this = *this + b;
+        }
+        variable& operator-=(X b)
+        {
+            return *this = *this - b;
+        }
+        variable& operator*=(X b)
+        {
+            return *this = *this*b;
+        }
+        variable& operator/=(X b)
+        {
+            return *this = *this/b;
+        }
+
+        // found by argument dependent lookup
+        friend variable exp(const variable& a)
+        {
+            X y = std::exp(a.x);
+
+            return unary(y, a, y);
+        }
+        friend variable log(const variable& a)
+        {
+            return unary(std::log(a.x), a, 1/a.x);
+        }
+        friend variable sqrt(const variable& a)
+        {
+            X y = std::sqrt(a.x);
+
+            return unary(y, a, 1/(2*y));
+        }
+        friend variable pow(const variable& a, X p)
+        {
+            return unary(std::pow(a.x, p), a, p*std::pow(a.x, p - 1));
+        }
+        friend variable pow(const variable& a, const variable& b)
+        {
+            X y = std::pow(a.x, b.x);
+
+            return binary(y, a, b.x*std::pow(a.x, b.x - 1), b, y*std::log(a.x));
+        }
+        friend variable erf(const variable& a)
+        {
+            return unary(std::erf(a.x), a, X(prob::sqrt4_pi)*std::exp(-a.x*a.x));
+        }
+        friend variable erfc(const variable& a)
+        {
+            return unary(std::erfc(a.x), a, -X(prob::sqrt4_pi)*std::exp(-a.x*a.x));
+        }
+        friend variable fabs(const variable& a)
+        {
+            return unary(std::fabs(a.x), a, std::copysign(X(1), a.x));
+        }
+        friend variable copysign(const variable& a, const variable& b)
+        {
+            return unary(std::copysign(a.x, b.x), a, std::copysign(X(1), a.x)*std::copysign(X(1), b.x));
+        }
+        friend variable nextafter(const variable& a, const variable& b)
+        {
+            return unary(std::nextafter(a.x, b.x), a, X(1));
+        }
+    };
+
+} // fms::adjoint
+
+namespace fms::root1d {
+
+    // Iterate without recording then record the root x of f(x, theta) = 0 once using
+    // dx/dtheta = -(df/dtheta)/(df/dx).
+    template<class X>
+    struct newton<adjoint::variable<X>> {
+        using V = adjoint::variable<X>;
+
+        static V solve(V x, const std::function<V(V)>& f, const std::function<V(V)>& df)
+        {
+            X dfdx;
+            {
+                typename adjoint::tape<X>::pause pause;
+                newton_solver<V,V> solver(x, f, df);
+                x = solver.solve();
+                dfdx = df(x).value();
+            }
+
+            return V::implicit(x.value(), f(V(x.value())), -1/dfdx);
+        }
+        static V solve(V x, const std::function<V(V)>& f, const std::function<V(V)>& df, V a, V b)
+        {
+            X dfdx;
+            {
+                typename adjoint::tape<X>::pause pause;
+                newton_solver<V,V> solver(x, f, df, a, b);
+                x = solver.solve();
+                dfdx = df(x).value();
+            }
+
+            return V::implicit(x.value(), f(V(x.value())), -1/dfdx);
+        }
+    };
+
+} // fms::root1d
+
+// NaN constant, e.g., default arguments of fms::pwflat
+template<class X>
+class std::numeric_limits<fms::adjoint::variable<X>> : public std::numeric_limits<X> {
+public:
+    static constexpr fms::adjoint::variable<X> quiet_NaN() noexcept
+    {
+        return std::numeric_limits<X>::quiet_NaN();
+    }
+};
@@ -5,28 +5,1135 @@
 // For any analytic function f, f(xI + J) = f(x)I + f'(x)J + f''(x)/2 J^2 + ...
 // This allows the derivatives of f to be computed using analytic numbers.
 // We say n is the _order_ of the analytic number.
+// analytic<X, N> has compile time order N and no allocations, analytic<X> has run time order.
+// Arithmetic on lazy::expr(x) builds expressions that allocate only the result when assigned.
 #pragma once
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <compare>
+#include <complex>
+#include <limits>
+#include <numbers>
+#include <type_traits>
+#include <utility>
 #include <valarray>
+#include <vector>
+#include "fms_prob.h"
 
 namespace fms {
-    
-    // Toeplitz matrix where first row is valarray<X>
+
+    // n!
     template<class X>
+    constexpr X factorial(X n)
+    {
+        X n_ = 1;
+
+        while (n > 0) {
+            n_ *= n;
+            --n;
+        };
+
+        return n_;
+    }
+
+    template<class X, size_t N = 0>
+    class analytic;
+
+    // Taylor coefficients of functions of analytic numbers in O(n^2) operations.
+    // If b = f(a) then b' = f'(a) a' so k b_k = sum_{1 <= j <= k} j a_j f'(a)_{k - j}.
+    namespace taylor {
+
+        // Truncated products c_k = sum_{i + j = k} a_i b_j for 0 <= k < n.
+        // The Karatsuba and FFT errors are relative to max |a_i b_j|, not to |c_k|,
+        // so scale J if the coefficients vary over many orders of magnitude.
+
+        // thresholds for product from test_fms_analytic_product
+        constexpr size_t unrolled_order = 8;
+        constexpr size_t karatsuba_order = 192;
+        constexpr size_t fft_order = 384;
+        // full products recurse to a smaller base case than truncated products
+        constexpr size_t karatsuba_full_order = 24;
+
+        // x_0 y_K + ... + x_K y_0
+        template<size_t K, class X, size_t... J>
+        constexpr X convolve(const X* a, const X* b, std::index_sequence<J...>)
+        {
+            return (X(0) + ... + (a[J]*b[K - J]));
+        }
+        // unrolled for compile time n
+        template<class X, size_t... K>
+        constexpr void product(const X* a, const X* b, X* c, std::index_sequence<K...>)
+        {
+            ((c[K] = convolve<K>(a, b, std::make_index_sequence<K + 1>{})), ...);
+        }
+
+        template<class X>
+        inline void schoolbook(size_t n, const X* a, const X* b, X* c)
+        {
+            for (size_t k = 0; k < n; ++k) {
+                X ck = 0;
+                for (size_t j = 0; j <= k; ++j) {
+                    ck += a[j]*b[k - j];
+                }
+                c[k] = ck;
+            }
+        }
+
+        // c[0, 2n - 1) = a[0, n) b[0, n) using scratch w[0, 6n)
+        template<class X>
+        inline void karatsuba_full(size_t n, const X* a, const X* b, X* c, X* w)
+        {
+            if (n < karatsuba_full_order) {
+                for (size_t k = 0; k < 2*n - 1; ++k) {
+                    X ck = 0;
+                    for (size_t j = k < n ? 0 : k - n + 1; j <= k && j < n; ++j) {
+                        ck += a[j]*b[k - j];
+                    }
+                    c[k] = ck;
+                }
+
+                return;
+            }
+
+            // a = a0 + a1 J^h, b = b0 + b1 J^h
+            size_t h = n/2, m = n - h;
+            karatsuba_full(h, a, b, c, w);
+            karatsuba_full(m, a + h, b + h, c + 2*h, w);
+            c[2*h - 1] = 0;
+
+            // (a0 + a1)(b0 + b1) - a0 b0 - a1 b1
+            X* a_ = w;
+            X* b_ = w + m;
+            X* c_ = w + 2*m;
+            for (size_t i = 0; i < m; ++i) {
+                a_[i] = (i < h ? a[i] : X(0)) + a[h + i];
+                b_[i] = (i < h ? b[i] : X(0)) + b[h + i];
+            }
+            karatsuba_full(m, a_, b_, c_, w + 4*m);
+            for (size_t i = 0; i < 2*h - 1; ++i) {
+                c_[i] -= c[i];
+            }
+            for (size_t i = 0; i < 2*m - 1; ++i) {
+                c_[i] -= c[2*h + i];
+            }
+            for (size_t i = 0; i < 2*m - 1; ++i) {
+                c[h + i] += c_[i];
+            }
+        }
+        // truncated a0 b0 by Karatsuba plus truncated a0 b1 + a1 b0 by recursion, w[0, 8n)
+        template<class X>
+        inline void karatsuba(size_t n, const X* a, const X* b, X* c, X* w)
+        {
+            if (n < karatsuba_order) {
+                schoolbook(n, a, b, c);
+
+                return;
+            }
+
+            size_t h = (n + 1)/2, m = n - h;
+            karatsuba_full(h, a, b, w, w + 2*h);
+            std::copy(w, w + 2*h - 1, c);
+            if (2*h - 1 < n) {
+                c[n - 1] = 0;
+            }
+            karatsuba(m, a, b + h, w, w + m);
+            for (size_t i = 0; i < m; ++i) {
+                c[h + i] += w[i];
+            }
+            karatsuba(m, a + h, b, w, w + m);
+            for (size_t i = 0; i < m; ++i) {
+                c[h + i] += w[i];
+            }
+        }
+        template<class X>
+        inline void karatsuba(size_t n, const X* a, const X* b, X* c)
+        {
+            std::vector<X> w(8*n);
+
+            karatsuba(n, a, b, c, w.data());
+        }
+
+        // in place radix 2 with twiddles w_j = exp(-2 pi i j/n), n a power of 2
+        template<class C>
+        inline void fourier(size_t n, C* z, const C* w, bool inverse = false)
+        {
+            for (size_t i = 1, j = 0; i < n; ++i) {
+                size_t bit = n >> 1;
+                for (; j & bit; bit >>= 1) {
+                    j ^= bit;
+                }
+                j ^= bit;
+                if (i < j) {
+                    std::swap(z[i], z[j]);
+                }
+            }
+            for (size_t len = 2; len <= n; len <<= 1) {
+                size_t step = n/len;
+                for (size_t i = 0; i < n; i += len) {
+                    for (size_t j = 0; j < len/2; ++j) {
+                        C wj = inverse ? conj(w[j*step]) : w[j*step];
+                        C u = z[i + j];
+                        C v = z[i + j + len/2]*wj;
+                        z[i + j] = u + v;
+                        z[i + j + len/2] = u - v;
+                    }
+                }
+            }
+        }
+        // (a + i b)^2 = a^2 - b^2 + 2i a b with b scaled to the size of a
+        template<class X>
+        inline void fft(size_t n, const X* a, const X* b, X* c)
+        {
+            using R = std::common_type_t<X, double>;
+            using C = std::complex<R>;
+
+            size_t L = 1;
+            while (L < 2*n - 1) {
+                L <<= 1;
+            }
+            R amax = 0, bmax = 0;
+            for (size_t i = 0; i < n; ++i) {
+                amax = std::max(amax, R(std::fabs(a[i])));
+                bmax = std::max(bmax, R(std::fabs(b[i])));
+            }
+            if (amax == 0 || bmax == 0) {
+                std::fill(c, c + n, X(0));
+
+                return;
+            }
+            R scale = amax/bmax;
+
+            std::vector<C> z(L), w(L/2);
+            for (size_t j = 0; j < L/2; ++j) {
+                w[j] = std::polar(R(1), -2*std::numbers::pi_v<R>*R(j)/R(L));
+            }
+            for (size_t i = 0; i < n; ++i) {
+                z[i] = C(a[i], b[i]*scale);
+            }
+            fourier(L, z.data(), w.data());
+            for (auto& zi : z) {
+                zi *= zi;
+            }
+            fourier(L, z.data(), w.data(), true);
+            for (size_t k = 0; k < n; ++k) {
+                c[k] = X(z[k].imag()/(2*scale*L));
+            }
+        }
+
+        // order adaptive truncated product, c must not alias a or b
+        template<class X>
+        inline void product(size_t n, const X* a, const X* b, X* c)
+        {
+            switch (n) {
+            case 0: return;
+            case 1: return product(a, b, c, std::make_index_sequence<1>{});
+            case 2: return product(a, b, c, std::make_index_sequence<2>{});
+            case 3: return product(a, b, c, std::make_index_sequence<3>{});
+            case 4: return product(a, b, c, std::make_index_sequence<4>{});
+            case 5: return product(a, b, c, std::make_index_sequence<5>{});
+            case 6: return product(a, b, c, std::make_index_sequence<6>{});
+            case 7: return product(a, b, c, std::make_index_sequence<7>{});
+            case 8: return product(a, b, c, std::make_index_sequence<8>{});
+            }
+            static_assert (unrolled_order == 8);
+
+            if (n < karatsuba_order) {
+                schoolbook(n, a, b, c);
+            }
+            else if (n < fft_order) {
+                karatsuba(n, a, b, c);
+            }
+            else {
+                fft(n, a, b, c);
+            }
+        }
+
+        // b_0 = b0 and b' = c a'
+        template<class X, size_t N>
+        inline analytic<X,N> chain(const analytic<X,N>& a, const analytic<X,N>& c, X b0)
+        {
+            analytic<X,N> b = a;
+
+            b[0] = b0;
+            for (size_t k = 1; k < a.order(); ++k) {
+                X bk = 0;
+                for (size_t j = 1; j <= k; ++j) {
+                    bk += X(j)*a[j]*c[k - j];
+                }
+                b[k] = bk/X(k);
+            }
+
+            return b;
+        }
+
+        // b' = b a'
+        template<class X, size_t N>
+        inline analytic<X,N> exp(const analytic<X,N>& a)
+        {
+            analytic<X,N> b = a;
+
+            b[0] = std::exp(a[0]);
+            for (size_t k = 1; k < a.order(); ++k) {
+                X bk = 0;
+                for (size_t j = 1; j <= k; ++j) {
+                    bk += X(j)*a[j]*b[k - j];
+                }
+                b[k] = bk/X(k);
+            }
+
+            return b;
+        }
+
+        // a b' = a'
+        template<class X, size_t N>
+        inline analytic<X,N> log(const analytic<X,N>& a)
+        {
+            analytic<X,N> b = a;
+
+            b[0] = std::log(a[0]);
+            for (size_t k = 1; k < a.order(); ++k) {
+                X bk = 0;
+                for (size_t j = 1; j < k; ++j) {
+                    bk += X(j)*b[j]*a[k - j];
+                }
+                b[k] = (a[k] - bk/X(k))/a[0];
+            }
+
+            return b;
+        }
+
+        // b b = a
+        template<class X, size_t N>
+        inline analytic<X,N> sqrt(const analytic<X,N>& a)
+        {
+            analytic<X,N> b = a;
+
+            b[0] = std::sqrt(a[0]);
+            for (size_t k = 1; k < a.order(); ++k) {
+                X bk = 0;
+                for (size_t j = 1; j < k; ++j) {
+                    bk += b[j]*b[k - j];
+                }
+                b[k] = (a[k] - bk)/(2*b[0]);
+            }
+
+            return b;
+        }
+
+        // a b' = p a' b
+        template<class X, size_t N>
+        inline analytic<X,N> pow(const analytic<X,N>& a, X p)
+        {
+            analytic<X,N> b = a;
+
+            b[0] = std::pow(a[0], p);
+            for (size_t k = 1; k < a.order(); ++k) {
+                X bk = 0;
+                for (size_t j = 1; j <= k; ++j) {
+                    bk += ((p + 1)*X(j) - X(k))*a[j]*b[k - j];
+                }
+                b[k] = bk/(X(k)*a[0]);
+            }
+
+            return b;
+        }
+        template<class X, size_t N>
+        inline analytic<X,N> pow(const analytic<X,N>& a, const analytic<X,N>& p)
+        {
+            return exp(p*log(a));
+        }
+
+        // c b = a, c has the order of a and b is zero past its order
+        template<class X, size_t N, size_t M>
+        constexpr analytic<X,N> div(const analytic<X,N>& a, const analytic<X,M>& b)
+        {
+            analytic<X,N> c = a;
+
+            for (size_t k = 0; k < a.order(); ++k) {
+                X ck = a[k];
+                for (size_t j = 1; j <= k && j < b.order(); ++j) {
+                    ck -= b[j]*c[k - j];
+                }
+                c[k] = ck/b[0];
+            }
+
+            return c;
+        }
+
+        // erf' = 2/sqrt(pi) exp(-x^2)
+        template<class X, size_t N>
+        inline analytic<X,N> erf(const analytic<X,N>& a)
+        {
+            return chain(a, exp(-a*a)*X(prob::sqrt4_pi), X(std::erf(a[0])));
+        }
+        template<class X, size_t N>
+        inline analytic<X,N> erfc(const analytic<X,N>& a)
+        {
+            return chain(a, exp(-a*a)*X(-prob::sqrt4_pi), X(std::erfc(a[0])));
+        }
+
+        template<class X, size_t N>
+        inline analytic<X,N> normal_pdf(const analytic<X,N>& a)
+        {
+            return exp(-a*a/X(2))*X(prob::sqrt1_2pi);
+        }
+        template<class X, size_t N>
+        inline analytic<X,N> normal_cdf(const analytic<X,N>& a)
+        {
+            return chain(a, normal_pdf(a), prob::normal_cdf(a[0]));
+        }
+
+    } // taylor
+
+    // Lazy arithmetic for analytic<X> with run time order.
+    // Operators return expressions holding their analytic operands and assignment evaluates
+    // every coefficient in the destination. Sums, differences, scalar operations, and products
+    // of those are fused into one loop over the coefficients. Other products and quotients are
+    // computed in place. Mixed orders have the same semantics as the eager operators: the result
+    // has the order of the left operand and the right operand is truncated or zero past its order.
+    // Like valarray expressions they refer to analytic lvalues, so assign them to an analytic
+    // instead of using auto.
+    namespace lazy {
+
+        // z op= y
+        struct assign {
+            template<class X>
+            void operator()(X& z, X y) const { z = y; }
+        };
+        struct add {
+            template<class X>
+            void operator()(X& z, X y) const { z += y; }
+        };
+        struct subtract {
+            template<class X>
+            void operator()(X& z, X y) const { z -= y; }
+        };
+
+        // analytic operand or expression with coefficients of A
+        template<class T, class A>
+        concept expression = requires {
+            requires std::is_same_v<typename std::remove_cvref_t<T>::analytic_type, A>;
+        };
+        template<class T, class A>
+        concept operand = std::is_same_v<std::remove_cvref_t<T>, A> || expression<T, A>;
+        // operators on analytic numbers are eager unless an operand is an expression
+        template<class L, class R, class A>
+        concept binary = operand<L, A> && operand<R, A> && (expression<L, A> || expression<R, A>);
+
+        // coefficient k, 0 past the order
+        template<class E>
+        inline auto at(const E& e, size_t k)
+        {
+            using X = std::remove_cvref_t<decltype(e[k])>;
+
+            return k < e.order() ? e[k] : X(0);
+        }
+
+        // z[k] op= e[k] from the top so e[k] can use z[j] for j <= k
+        template<class E, class X, class Op>
+        inline void loop(const E& e, X* z, size_t n, Op op)
+        {
+            for (size_t k = n; k-- > 0; ) {
+                op(z[k], e[k]);
+            }
+        }
+
+        // call f with e or, if e is not elementwise, its value
+        template<class A, class E, class F>
+        inline void coefficients(const E& e, F f)
+        {
+            if constexpr (E::elementwise) {
+                f(e);
+            }
+            else {
+                f(A(e));
+            }
+        }
+
+        // Expressions have an order and eval sets z[k] op= e_k for k < n <= order().
+        // They hold references to analytic lvalues so assign them to an analytic
+        // before the full expression ends. Indexing and comparison evaluate them.
+        // Generators compute e[k] from coefficients j <= k of their operands, in constant
+        // time if they are elementwise, and are evaluated by loop when fused.
+        // The destination z might be the storage of p if aliases(p) and assigning
+        // in place is correct when safe(p).
+
+        // analytic operand, held by value if it was an rvalue
+        template<class A, bool own = false>
+        class term {
+            std::conditional_t<own, A, const A&> a;
+        public:
+            using analytic_type = A;
+            using value_type = typename A::value_type;
+            static constexpr bool elementwise = true;
+            static constexpr bool generator = true;
+
+            term(const A& a)
+                : a(a)
+            { }
+            term(A&& a) requires own
+                : a(std::move(a))
+            { }
+
+            size_t order() const
+            {
+                return a.order();
+            }
+            value_type operator[](size_t k) const
+            {
+                return a[k];
+            }
+            bool fused() const
+            {
+                return true;
+            }
+            bool aliases(const A* p) const
+            {
+                return !own && &a == p;
+            }
+            bool safe(const A*) const
+            {
+                return true;
+            }
+            template<class Op>
+            void eval(value_type* z, size_t n, Op op) const
+            {
+                loop(*this, z, n, op);
+            }
+        };
+
+        // term for lvalues and rvalues of A, expressions are copied or moved
+        template<class A, class T>
+        inline auto node(T&& t)
+        {
+            if constexpr (!std::is_same_v<std::remove_cvref_t<T>, A>) {
+                return std::remove_cvref_t<T>(std::forward<T>(t));
+            }
+            else if constexpr (std::is_lvalue_reference_v<T>) {
+                return term<A>(t);
+            }
+            else {
+                return term<A,true>(std::move(t));
+            }
+        }
+
+        // Opt in to lazy evaluation, e.g., z = expr(a)*b + expr(c)*d - e.
+        template<class X>
+        inline auto expr(const analytic<X>& a)
+        {
+            return term<analytic<X>>(a);
+        }
+        template<class X>
+        inline auto expr(analytic<X>&& a)
+        {
+            return term<analytic<X>,true>(std::move(a));
+        }
+        // compile time order does not allocate
+        template<class X, size_t N> requires (N > 0)
+        inline const analytic<X,N>& expr(const analytic<X,N>& a)
+        {
+            return a;
+        }
+
+        // c I with order n
+        template<class A>
+        class constant {
+            using X = typename A::value_type;
+            X c;
+            size_t n;
+        public:
+            using analytic_type = A;
+            using value_type = X;
+            static constexpr bool elementwise = true;
+            static constexpr bool generator = true;
+
+            constant(X c, size_t n)
+                : c(c), n(n)
+            { }
+
+            size_t order() const
+            {
+                return n;
+            }
+            X operator[](size_t k) const
+            {
+                return k == 0 ? c : X(0);
+            }
+            bool fused() const
+            {
+                return true;
+            }
+            bool aliases(const A*) const
+            {
+                return false;
+            }
+            bool safe(const A*) const
+            {
+                return true;
+            }
+            template<class Op>
+            void eval(X* z, size_t n, Op op) const
+            {
+                loop(*this, z, n, op);
+            }
+        };
+
+        // coefficient maps for unary minus and scalar operations
+        template<class X>
+        struct negate {
+            X operator()(size_t, X a) const { return -a; }
+        };
+        template<class X>
+        struct plus_scalar {
+            X s;
+            X operator()(size_t k, X a) const { return k == 0 ? a + s : a; }
+        };
+        template<class X>
+        struct minus_scalar {
+            X s;
+            X operator()(size_t k, X a) const { return k == 0 ? a - s : a; }
+        };
+        template<class X>
+        struct scalar_minus {
+            X s;
+            X operator()(size_t k, X a) const { return k == 0 ? -a + s : -a; }
+        };
+        template<class X>
+        struct times_scalar {
+            X s;
+            X operator()(size_t, X a) const { return a*s; }
+        };
+        template<class X>
+        struct divides_scalar {
+            X s;
+            X operator()(size_t, X a) const { return a/s; }
+        };
+
+        // f(k, e_k)
+        template<class F, class E>
+        class map {
+            F f;
+            E e;
+        public:
+            using analytic_type = typename E::analytic_type;
+            using value_type = typename E::value_type;
+            static constexpr bool elementwise = E::elementwise;
+            static constexpr bool generator = E::generator;
+
+            map(F f, E e)
+                : f(f), e(std::move(e))
+            { }
+
+            size_t order() const
+            {
+                return e.order();
+            }
+            value_type operator[](size_t k) const
+            {
+                return f(k, e[k]);
+            }
+            bool fused() const
+            {
+                return generator && e.fused();
+            }
+            bool aliases(const analytic_type* p) const
+            {
+                return e.aliases(p);
+            }
+            bool safe(const analytic_type* p) const
+            {
+                return fused() || e.safe(p);
+            }
+            template<class Op>
+            void eval(value_type* z, size_t n, Op op) const
+            {
+                if constexpr (generator) {
+                    if (fused()) {
+                        return loop(*this, z, n, op);
+                    }
+                }
+                if constexpr (std::is_same_v<Op, assign>) {
+                    e.eval(z, n, op);
+                    for (size_t k = 0; k < n; ++k) {
+                        z[k] = f(k, z[k]);
+                    }
+                }
+                else {
+                    loop(analytic_type(*this), z, n, op);
+                }
+            }
+        };
+
+        // l + r or l - r
+        template<class Op, class L, class R>
+        class sum {
+            L l;
+            R r;
+        public:
+            using analytic_type = typename L::analytic_type;
+            using value_type = typename L::value_type;
+            static constexpr bool elementwise = L::elementwise && R::elementwise;
+            static constexpr bool generator = L::generator && R::generator;
+
+            sum(Op, L l, R r)
+                : l(std::move(l)), r(std::move(r))
+            { }
+
+            size_t order() const
+            {
+                return l.order();
+            }
+            value_type operator[](size_t k) const
+            {
+                value_type y = l[k];
+                if (k < r.order()) {
+                    Op{}(y, r[k]);
+                }
+
+                return y;
+            }
+            bool fused() const
+            {
+                return generator && l.fused() && r.fused();
+            }
+            bool aliases(const analytic_type* p) const
+            {
+                return l.aliases(p) || r.aliases(p);
+            }
+            bool safe(const analytic_type* p) const
+            {
+                return fused() || (l.safe(p) && !r.aliases(p));
+            }
+            template<class Op_>
+            void eval(value_type* z, size_t n, Op_ op) const
+            {
+                if constexpr (generator) {
+                    if (fused()) {
+                        return loop(*this, z, n, op);
+                    }
+                }
+                if constexpr (std::is_same_v<Op_, assign>) {
+                    l.eval(z, n, op);
+                    r.eval(z, std::min(n, r.order()), Op{});
+                }
+                else {
+                    loop(analytic_type(*this), z, n, op);
+                }
+            }
+        };
+
+        // truncated product, see taylor::product
+        template<class L, class R>
+        class product {
+            L l;
+            R r;
+        public:
+            using analytic_type = typename L::analytic_type;
+            using value_type = typename L::value_type;
+            static constexpr bool elementwise = false;
+            static constexpr bool generator = L::elementwise && R::elementwise;
+
+            product(L l, R r)
+                : l(std::move(l)), r(std::move(r))
+            { }
+
+            size_t order() const
+            {
+                return l.order();
+            }
+            value_type operator[](size_t k) const
+            {
+                value_type ck = 0;
+                for (size_t j = 0; j <= k; ++j) {
+                    ck += l[j]*at(r, k - j);
+                }
+
+                return ck;
+            }
+            // schoolbook orders
+            bool fused() const
+            {
+                return generator && order() < taylor::karatsuba_order;
+            }
+            bool aliases(const analytic_type* p) const
+            {
+                return l.aliases(p) || r.aliases(p);
+            }
+            bool safe(const analytic_type* p) const
+            {
+                return L::elementwise || order() >= taylor::karatsuba_order
+                    || (l.safe(p) && !(R::elementwise && r.aliases(p)));
+            }
+            template<class Op>
+            void eval(value_type* z, size_t n, Op op) const
+            {
+                using X = value_type;
+                using A = analytic_type;
+
+                if constexpr (generator) {
+                    if (fused()) {
+                        return loop(*this, z, n, op);
+                    }
+                }
+                if (order() >= taylor::karatsuba_order) {
+                    coefficients<A>(l, [&](const auto& a) {
+                        coefficients<A>(r, [&](const auto& b) {
+                            std::vector<X> a_(order()), b_(order()), c(order());
+                            for (size_t k = 0; k < order(); ++k) {
+                                a_[k] = a[k];
+                                b_[k] = at(b, k);
+                            }
+                            taylor::product(order(), a_.data(), b_.data(), c.data());
+                            loop(c, z, n, op);
+                        });
+                    });
+                }
+                else if constexpr (L::elementwise) {
+                    A b(r);
+                    for (size_t k = n; k-- > 0; ) {
+                        X ck = 0;
+                        for (size_t j = 0; j <= k; ++j) {
+                            ck += l[j]*at(b, k - j);
+                        }
+                        op(z[k], ck);
+                    }
+                }
+                else if constexpr (std::is_same_v<Op, assign>) {
+                    coefficients<A>(r, [&](const auto& b) {
+                        l.eval(z, n, op);
+                        for (size_t k = n; k-- > 0; ) {
+                            X ck = 0;
+                            for (size_t j = 0; j <= k; ++j) {
+                                ck += z[j]*at(b, k - j);
+                            }
+                            z[k] = ck;
+                        }
+                    });
+                }
+                else {
+                    loop(A(*this), z, n, op);
+                }
+            }
+        };
+
+        // c r = l, see taylor::div
+        template<class L, class R>
+        class quotient {
+            L l;
+            R r;
+        public:
+            using analytic_type = typename L::analytic_type;
+            using value_type = typename L::value_type;
+            static constexpr bool elementwise = false;
+            static constexpr bool generator = false;
+
+            quotient(L l, R r)
+                : l(std::move(l)), r(std::move(r))
+            { }
+
+            size_t order() const
+            {
+                return l.order();
+            }
+            // evaluates the quotient, use an analytic for repeated access
+            value_type operator[](size_t k) const
+            {
+                return analytic_type(*this)[k];
+            }
+            bool fused() const
+            {
+                return false;
+            }
+            bool aliases(const analytic_type* p) const
+            {
+                return l.aliases(p) || r.aliases(p);
+            }
+            bool safe(const analytic_type* p) const
+            {
+                return l.safe(p) && !(R::elementwise && r.aliases(p));
+            }
+            template<class Op>
+            void eval(value_type* z, size_t n, Op op) const
+            {
+                using X = value_type;
+                using A = analytic_type;
+
+                if constexpr (std::is_same_v<Op, assign>) {
+                    coefficients<A>(r, [&](const auto& b) {
+                        l.eval(z, n, op);
+                        for (size_t k = 0; k < n; ++k) {
+                            X ck = z[k];
+                            for (size_t j = 1; j <= k && j < b.order(); ++j) {
+                                ck -= b[j]*z[k - j];
+                            }
+                            z[k] = ck/b[0];
+                        }
+                    });
+                }
+                else {
+                    loop(A(*this), z, n, op);
+                }
+            }
+        };
+
+    } // lazy
+
+    // Toeplitz matrix where first row is array<X,N>
+    template<class X, size_t N>
     class analytic {
-        std::valarray<X> x;
+        std::array<X,N> x;
+    public:
+        // 0
+        constexpr analytic()
+            : x{}
+        { }
+        // x0 I
+        constexpr analytic(X x0)
+            : x{}
+        {
+            x[0] = x0;
+        }
+        // converting constructor for x0 I + J
+        constexpr analytic(std::initializer_list<X> xs)
+            : x{}
+        {
+            for (size_t i = 0; i < N && i < xs.size(); ++i) {
+                x[i] = xs.begin()[i];
+            }
+        }
+        // truncate or pad with zeros
+        template<size_t M>
+        constexpr explicit analytic(const analytic<X,M>& y)
+            : x{}
+        {
+            for (size_t i = 0; i < N && i < y.order(); ++i) {
+                x[i] = y[i];
+            }
+        }
+        // yI
+        constexpr analytic& operator=(X y)
+        {
+            x = {};
+            x[0] = y;
+
+            return *this;
+        }
+
+        template<size_t M>
+        constexpr bool operator==(const analytic<X,M>& y) const
+        {
+            for (size_t i = 0; i < std::max(order(), y.order()); ++i) {
+                if ((i < order() ? x[i] : X(0)) != (i < y.order() ? y[i] : X(0))) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+        template<size_t M>
+        constexpr bool operator!=(const analytic<X,M>& y) const
+        {
+            return !operator==(y);
+        }
+
+        // yI
+        friend constexpr bool operator==(const analytic& x, X y)
+        {
+            return x == analytic<X,1>{y};
+        }
+        // ordered by value for branches in pricers
+        friend constexpr auto operator<=>(const analytic& x, const analytic& y)
+        {
+            return x[0] <=> y[0];
+        }
+        friend constexpr auto operator<=>(const analytic& x, X y)
+        {
+            return x[0] <=> y;
+        }
+
+        static constexpr size_t order()
+        {
+            return N;
+        }
+        constexpr X operator[](size_t i) const
+        {
+            return x[i];
+        }
+        constexpr X& operator[](size_t i)
+        {
+            return x[i];
+        }
+        // i-th derivative
+        constexpr X operator()(size_t i) const
+        {
+            return x[i]*factorial(X(i));
+        }
+
+        constexpr analytic& operator+=(const analytic& y)
+        {
+            [&]<size_t... I>(std::index_sequence<I...>) {
+                ((x[I] += y.x[I]), ...);
+            }(std::make_index_sequence<N>{});
+
+            return *this;
+        }
+        template<size_t M>
+        constexpr analytic& operator+=(const analytic<X,M>& y)
+        {
+            return operator+=(analytic(y));
+        }
+        // non-member friend
+        template<size_t M>
+        friend constexpr analytic operator+(analytic x, const analytic<X,M>& y)
+        {
+            return x += y;
+        }
+        constexpr analytic& operator-=(const analytic& y)
+        {
+            [&]<size_t... I>(std::index_sequence<I...>) {
+                ((x[I] -= y.x[I]), ...);
+            }(std::make_index_sequence<N>{});
+
+            return *this;
+        }
+        template<size_t M>
+        constexpr analytic& operator-=(const analytic<X,M>& y)
+        {
+            return operator-=(analytic(y));
+        }
+        // non-member friend
+        template<size_t M>
+        friend constexpr analytic operator-(analytic x, const analytic<X,M>& y)
+        {
+            return x -= y;
+        }
+
+        // sum_i x_i J^i sum_j y_i J^j = sum_{i + j = k} x_i y_j J^k
+        constexpr analytic& operator*=(const analytic& y)
+        {
+            std::array<X,N> z{};
+            taylor::product(x.data(), y.x.data(), z.data(), std::make_index_sequence<N>{});
+            x = z;
+
+            return *this;
+        }
+        template<size_t M>
+        constexpr analytic& operator*=(const analytic<X,M>& y)
+        {
+            return operator*=(analytic(y));
+        }
+        // non-member friend
+        template<size_t M>
+        friend constexpr analytic operator*(analytic x, const analytic<X,M>& y)
+        {
+            return x *= y;
+        }
+
+        constexpr analytic& operator/=(const analytic& y)
+        {
+            return *this = taylor::div(*this, y);
+        }
+        template<size_t M>
+        constexpr analytic& operator/=(const analytic<X,M>& y)
+        {
+            return operator/=(analytic(y));
+        }
+        // non-member friend
+        template<size_t M>
+        friend constexpr analytic operator/(analytic x, const analytic<X,M>& y)
+        {
+            return x /= y;
+        }
+
+        constexpr analytic operator-() const
+        {
+            analytic y;
+
+            [&]<size_t... I>(std::index_sequence<I...>) {
+                ((y.x[I] = -x[I]), ...);
+            }(std::make_index_sequence<N>{});
+
+            return y;
+        }
+
+        // scalars
+        constexpr analytic& operator+=(X y)
+        {
+            x[0] += y;
+
+            return *this;
+        }
+        friend constexpr analytic operator+(analytic x, X y)
+        {
+            return x += y;
+        }
+        friend constexpr analytic operator+(X x, analytic y)
+        {
+            return y += x;
+        }
+        constexpr analytic& operator-=(X y)
+        {
+            x[0] -= y;
 
-        static constexpr X factorial(X n)
+            return *this;
+        }
+        friend constexpr analytic operator-(analytic x, X y)
+        {
+            return x -= y;
+        }
+        friend constexpr analytic operator-(X x, const analytic& y)
         {
-            X n_ = 1; // n!
+            return -y += x;
+        }
+        constexpr analytic& operator*=(X y)
+        {
+            [&]<size_t... I>(std::index_sequence<I...>) {
+                ((x[I] *= y), ...);
+            }(std::make_index_sequence<N>{});
 
-            while (n > 0) {
-                n_ *= n;
-                --n;
-            };
+            return *this;
+        }
+        friend constexpr analytic operator*(analytic x, X y)
+        {
+            return x *= y;
+        }
+        friend constexpr analytic operator*(X x, analytic y)
+        {
+            return y *= x;
+        }
+        constexpr analytic& operator/=(X y)
+        {
+            [&]<size_t... I>(std::index_sequence<I...>) {
+                ((x[I] /= y), ...);
+            }(std::make_index_sequence<N>{});
 
-            return n_;
+            return *this;
+        }
+        friend constexpr analytic operator/(analytic x, X y)
+        {
+            return x /= y;
+        }
+        friend constexpr analytic operator/(X x, const analytic& y)
+        {
+            return taylor::div(analytic(x), y);
         }
+
+        // found by argument dependent lookup, see taylor
+        friend analytic exp(const analytic& a) { return taylor::exp(a); }
+        friend analytic log(const analytic& a) { return taylor::log(a); }
+        friend analytic sqrt(const analytic& a) { return taylor::sqrt(a); }
+        friend analytic pow(const analytic& a, X p) { return taylor::pow(a, p); }
+        friend analytic pow(const analytic& a, const analytic& p) { return taylor::pow(a, p); }
+        friend analytic erf(const analytic& a) { return taylor::erf(a); }
+        friend analytic erfc(const analytic& a) { return taylor::erfc(a); }
+    };
+
+    // Toeplitz matrix where first row is valarray<X>
+    template<class X>
+    class analytic<X,0> {
+        std::valarray<X> x;
+
         auto left(size_t n) const // take n
         {
             return std::slice(0, n, 1);
@@ -35,7 +1142,47 @@ namespace fms {
         {
             return std::slice(order() - n, n, 1);
         }
+        X* data()
+        {
+            return order() ? &x[0] : nullptr;
+        }
+        // in place from the top, y[k] for k < order() is not modified before it is used
+        template<class Y>
+        void multiply(const Y& y)
+        {
+            if (order() < taylor::karatsuba_order) {
+                for (size_t k = order(); k-- > 0; ) {
+                    X xk = 0;
+                    for (size_t j = 0; j <= k; ++j) {
+                        xk += x[j]*lazy::at(y, k - j);
+                    }
+                    x[k] = xk;
+                }
+            }
+            else {
+                std::valarray<X> y_(order()), z(order());
+                for (size_t k = 0; k < order() && k < y.order(); ++k) {
+                    y_[k] = y[k];
+                }
+                taylor::product(order(), &x[0], &y_[0], &z[0]);
+                std::swap(x, z);
+            }
+        }
+        // in place, y must not alias x
+        template<class Y>
+        void divide(const Y& y)
+        {
+            for (size_t k = 0; k < order(); ++k) {
+                X xk = x[k];
+                for (size_t j = 1; j <= k && j < y.order(); ++j) {
+                    xk -= y[j]*x[k - j];
+                }
+                x[k] = xk/y[0];
+            }
+        }
     public:
+        using value_type = X;
+
         explicit analytic(size_t n)
             : x(n)
         { }
@@ -48,6 +1195,17 @@ namespace fms {
             : x(y.x)
         {
         }
+        analytic(analytic&& y) noexcept
+            : x(std::move(y.x))
+        {
+        }
+        // evaluate e with one allocation
+        template<class E> requires lazy::expression<E, analytic>
+        analytic(const E& e)
+            : x(e.order())
+        {
+            e.eval(data(), order(), lazy::assign{});
+        }
         analytic& operator=(const analytic& y)
         {
             x.resize(y.x.size());
@@ -55,6 +1213,29 @@ namespace fms {
 
             return *this;
         }
+        analytic& operator=(analytic&& y) noexcept
+        {
+            std::swap(x, y.x);
+
+            return *this;
+        }
+        // in place unless e depends on coefficients it would overwrite
+        template<class E> requires lazy::expression<E, analytic>
+        analytic& operator=(const E& e)
+        {
+            if (order() != e.order() ? e.aliases(this) : !e.safe(this)) {
+                analytic y(e);
+                std::swap(x, y.x);
+            }
+            else {
+                if (order() != e.order()) {
+                    x.resize(e.order());
+                }
+                e.eval(data(), order(), lazy::assign{});
+            }
+
+            return *this;
+        }
         // yI
         analytic& operator=(X y)
         {
@@ -83,6 +1264,36 @@ namespace fms {
         {
             return !operator==(y);
         }
+        // yI
+        friend bool operator==(const analytic& x, X y)
+        {
+            return x == analytic{y};
+        }
+        // expressions compare by value, != is rewritten
+        template<class E, size_t M> requires lazy::expression<E, analytic>
+        friend bool operator==(const E& e, const analytic<X,M>& y)
+        {
+            return y == analytic(e);
+        }
+        template<class L, class R> requires lazy::expression<L, analytic> && lazy::expression<R, analytic>
+        friend bool operator==(const L& l, const R& r)
+        {
+            return analytic(l) == analytic(r);
+        }
+        template<class E> requires lazy::expression<E, analytic>
+        friend bool operator==(const E& e, X y)
+        {
+            return analytic(e) == y;
+        }
+        // ordered by value
+        friend auto operator<=>(const analytic& x, const analytic& y)
+        {
+            return x[0] <=> y[0];
+        }
+        friend auto operator<=>(const analytic& x, X y)
+        {
+            return x[0] <=> y;
+        }
 
         size_t order() const
         {
@@ -92,10 +1303,14 @@ namespace fms {
         {
             return x[i];
         }
+        X& operator[](size_t i)
+        {
+            return x[i];
+        }
         // i-th derivative
         X operator()(size_t i) const
         {
-            return x[i]*factorial(i);
+            return x[i]*factorial(X(i));
         }
         // results in x0 I
         analytic& resize(size_t n, const X x0 = X(0))
@@ -120,11 +1335,24 @@ namespace fms {
 
             return *this;
         }
+        template<class E> requires lazy::expression<E, analytic>
+        analytic& operator+=(const E& e)
+        {
+            e.eval(data(), std::min(order(), e.order()), lazy::add{});
+
+            return *this;
+        }
         // non-member friend
         friend analytic operator+(analytic x, const analytic& y)
         {
             return x += y;
         }
+        // lazy non-member friend
+        template<class L, class R> requires lazy::binary<L, R, analytic>
+        friend auto operator+(L&& l, R&& r)
+        {
+            return lazy::sum(lazy::add{}, lazy::node<analytic>(std::forward<L>(l)), lazy::node<analytic>(std::forward<R>(r)));
+        }
         analytic& operator-=(const analytic& y)
         {
             if (order() > y.order()) {
@@ -139,25 +1367,36 @@ namespace fms {
 
             return *this;
         }
+        template<class E> requires lazy::expression<E, analytic>
+        analytic& operator-=(const E& e)
+        {
+            e.eval(data(), std::min(order(), e.order()), lazy::subtract{});
+
+            return *this;
+        }
         // non-member friend
         friend analytic operator-(analytic x, const analytic& y)
         {
             return x -= y;
         }
+        // lazy non-member friend
+        template<class L, class R> requires lazy::binary<L, R, analytic>
+        friend auto operator-(L&& l, R&& r)
+        {
+            return lazy::sum(lazy::subtract{}, lazy::node<analytic>(std::forward<L>(l)), lazy::node<analytic>(std::forward<R>(r)));
+        }
 
         // sum_i x_i J^i sum_j y_i J^j = sum_{i + j = k} x_i y_j J^k
         analytic& operator*=(const analytic& y)
         {
-            std::valarray<X> z(order());
+            multiply(y);
 
-            for (size_t i = 0; i < z.size(); ++i) {
-                for (size_t j = 0; j <= i; ++j) {
-                    if (i - j < y.x.size()) {
-                        z[i] += x[j]*y.x[i - j];
-                    }
-                }
-            }
-            std::swap(x, z);
+            return *this;
+        }
+        template<class E> requires lazy::expression<E, analytic>
+        analytic& operator*=(const E& e)
+        {
+            lazy::coefficients<analytic>(e, [this](const auto& y) { multiply(y); });
 
             return *this;
         }
@@ -166,6 +1405,182 @@ namespace fms {
         {
             return x *= y;
         }
+        // lazy non-member friend
+        template<class L, class R> requires lazy::binary<L, R, analytic>
+        friend auto operator*(L&& l, R&& r)
+        {
+            return lazy::product(lazy::node<analytic>(std::forward<L>(l)), lazy::node<analytic>(std::forward<R>(r)));
+        }
+
+        analytic& operator/=(const analytic& y)
+        {
+            if (&y == this) {
+                return *this = taylor::div(*this, y);
+            }
+            divide(y);
+
+            return *this;
+        }
+        template<class E> requires lazy::expression<E, analytic>
+        analytic& operator/=(const E& e)
+        {
+            if (e.aliases(this)) {
+                return *this /= analytic(e);
+            }
+            lazy::coefficients<analytic>(e, [this](const auto& y) { divide(y); });
+
+            return *this;
+        }
+        // non-member friend
+        friend analytic operator/(analytic x, const analytic& y)
+        {
+            return x /= y;
+        }
+        // lazy non-member friend
+        template<class L, class R> requires lazy::binary<L, R, analytic>
+        friend auto operator/(L&& l, R&& r)
+        {
+            return lazy::quotient(lazy::node<analytic>(std::forward<L>(l)), lazy::node<analytic>(std::forward<R>(r)));
+        }
+
+        analytic operator-() const
+        {
+            analytic y(*this);
+            y.x = -x;
+
+            return y;
+        }
+        template<class E> requires lazy::expression<E, analytic>
+        friend auto operator-(E&& e)
+        {
+            return lazy::map(lazy::negate<X>{}, lazy::node<analytic>(std::forward<E>(e)));
+        }
+
+        // scalars
+        analytic& operator+=(X y)
+        {
+            x[0] += y;
+
+            return *this;
+        }
+        friend analytic operator+(analytic x, X y)
+        {
+            return x += y;
+        }
+        friend analytic operator+(X x, analytic y)
+        {
+            return y += x;
+        }
+        template<class E> requires lazy::expression<E, analytic>
+        friend auto operator+(E&& e, X y)
+        {
+            return lazy::map(lazy::plus_scalar<X>{y}, lazy::node<analytic>(std::forward<E>(e)));
+        }
+        template<class E> requires lazy::expression<E, analytic>
+        friend auto operator+(X y, E&& e)
+        {
+            return lazy::map(lazy::plus_scalar<X>{y}, lazy::node<analytic>(std::forward<E>(e)));
+        }
+        analytic& operator-=(X y)
+        {
+            x[0] -= y;
+
+            return *this;
+        }
+        friend analytic operator-(analytic x, X y)
+        {
+            return x -= y;
+        }
+        friend analytic operator-(X x, const analytic& y)
+        {
+            return -y += x;
+        }
+        template<class E> requires lazy::expression<E, analytic>
+        friend auto operator-(E&& e, X y)
+        {
+            return lazy::map(lazy::minus_scalar<X>{y}, lazy::node<analytic>(std::forward<E>(e)));
+        }
+        template<class E> requires lazy::expression<E, analytic>
+        friend auto operator-(X y, E&& e)
+        {
+            return lazy::map(lazy::scalar_minus<X>{y}, lazy::node<analytic>(std::forward<E>(e)));
+        }
+        analytic& operator*=(X y)
+        {
+            x *= y;
+
+            return *this;
+        }
+        friend analytic operator*(analytic x, X y)
+        {
+            return x *= y;
+        }
+        friend analytic operator*(X x, analytic y)
+        {
+            return y *= x;
+        }
+        template<class E> requires lazy::expression<E, analytic>
+        friend auto operator*(E&& e, X y)
+        {
+            return lazy::map(lazy::times_scalar<X>{y}, lazy::node<analytic>(std::forward<E>(e)));
+        }
+        template<class E> requires lazy::expression<E, analytic>
+        friend auto operator*(X y, E&& e)
+        {
+            return lazy::map(lazy::times_scalar<X>{y}, lazy::node<analytic>(std::forward<E>(e)));
+        }
+        analytic& operator/=(X y)
+        {
+            x /= y;
+
+            return *this;
+        }
+        friend analytic operator/(analytic x, X y)
+        {
+            return x /= y;
+        }
+        friend analytic operator/(X x, const analytic& y)
+        {
+            analytic x_(y.order());
+            x_ = x;
+
+            return x_ /= y;
+        }
+        template<class E> requires lazy::expression<E, analytic>
+        friend auto operator/(E&& e, X y)
+        {
+            return lazy::map(lazy::divides_scalar<X>{y}, lazy::node<analytic>(std::forward<E>(e)));
+        }
+        // yI with the order of e divided by e
+        template<class E> requires lazy::expression<E, analytic>
+        friend auto operator/(X y, E&& e)
+        {
+            size_t n = e.order();
+
+            return lazy::quotient(lazy::constant<analytic>(y, n), lazy::node<analytic>(std::forward<E>(e)));
+        }
 
+        // found by argument dependent lookup, see taylor
+        friend analytic exp(const analytic& a) { return taylor::exp(a); }
+        friend analytic log(const analytic& a) { return taylor::log(a); }
+        friend analytic sqrt(const analytic& a) { return taylor::sqrt(a); }
+        friend analytic pow(const analytic& a, X p) { return taylor::pow(a, p); }
+        friend analytic pow(const analytic& a, const analytic& p) { return taylor::pow(a, p); }
+        friend analytic erf(const analytic& a) { return taylor::erf(a); }
+        friend analytic erfc(const analytic& a) { return taylor::erfc(a); }
     };
+
+    // analytic{x0, x1, ...} has run time order
+    template<class X>
+    analytic(std::initializer_list<X>) -> analytic<X>;
 }
+
+// NaN value with zero derivatives, e.g., default arguments of fms::pwflat
+template<class X, size_t N>
+class std::numeric_limits<fms::analytic<X,N>> : public std::numeric_limits<X> {
+public:
+    static constexpr fms::analytic<X,N> quiet_NaN() noexcept
+    {
+        return std::numeric_limits<X>::quiet_NaN();
+    }
+};
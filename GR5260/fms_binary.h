@@ -0,0 +1,226 @@
+// fms_binary.h - versioned binary files for curves and portfolios that can be memory mapped
+// A file is a header followed by arrays each starting on an 8 byte boundary.
+// curve:     header | t[n] | f[n] | _f
+// portfolio: header | offset[n + 1] | u[m] | c[m]
+// Mapped files are copy on write so the arrays can be handed to the unmanaged
+// memory constructors of pwflat::curve and fixed_income::portfolio without copying.
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <utility>
+#include "fms_fixed_income_portfolio.h"
+#include "fms_pwflat.h"
+#include "../xll12/xll/ensure.h"
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fms::binary {
+
+    constexpr char magic[8] = { 'F', 'M', 'S', 'B', 'I', 'N', 0, 0 };
+    constexpr uint32_t version = 1;
+
+    enum class type : uint32_t {
+        curve = 1,
+        portfolio = 2,
+    };
+
+    struct header {
+        char magic[8];
+        uint32_t version;
+        uint32_t type;
+        uint32_t time_size; // sizeof time type
+        uint32_t cash_size; // sizeof cash or rate type
+        uint64_t n;         // number of curve times or instruments
+        uint64_t m;         // number of cash flows
+    };
+    static_assert(sizeof(header) % 8 == 0);
+
+    // bytes used by an array of n X's padded to 8 byte boundary
+    template<class X>
+    inline constexpr size_t bytes(size_t n)
+    {
+        return (n*sizeof(X) + 7) & ~size_t(7);
+    }
+
+    template<class X>
+    inline void write_array(std::ofstream& os, size_t n, const X* x)
+    {
+        static const char pad[8] = { 0 };
+
+        os.write(reinterpret_cast<const char*>(x), n*sizeof(X));
+        os.write(pad, bytes<X>(n) - n*sizeof(X));
+    }
+
+    template<class T, class F>
+    inline void write(const char* file, const pwflat::curve<T,F>& f)
+    {
+        std::ofstream os(file, std::ios::binary);
+        ensure (os);
+
+        header h{ {}, version, static_cast<uint32_t>(type::curve), sizeof(T), sizeof(F), f.size(), 0 };
+        std::memcpy(h.magic, magic, sizeof(magic));
+        write_array(os, 1, &h);
+        write_array(os, f.size(), f.time());
+        write_array(os, f.size(), f.rate());
+        write_array(os, 1, &f.extrapolate());
+
+        ensure (os);
+    }
+
+    template<class U, class C>
+    inline void write(const char* file, const fixed_income::portfolio<U,C>& P)
+    {
+        static_assert(sizeof(size_t) == sizeof(uint64_t));
+        std::ofstream os(file, std::ios::binary);
+        ensure (os);
+
+        header h{ {}, version, static_cast<uint32_t>(type::portfolio), sizeof(U), sizeof(C), P.size(), P.cash_flows() };
+        std::memcpy(h.magic, magic, sizeof(magic));
+        write_array(os, 1, &h);
+        write_array(os, P.size() + 1, P.offset());
+        write_array(os, P.cash_flows(), P.time());
+        write_array(os, P.cash_flows(), P.cash());
+
+        ensure (os);
+    }
+
+    // Read only file mapped copy on write. Views returned by curve() and portfolio() are valid
+    // while the file is mapped.
+    class mapped_file {
+        char* p;
+        size_t n;
+#ifdef _WIN32
+        HANDLE h;
+#endif
+    public:
+        mapped_file(const char* file)
+            : p(nullptr), n(0)
+        {
+#ifdef _WIN32
+            HANDLE f = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            ensure (f != INVALID_HANDLE_VALUE);
+            LARGE_INTEGER size;
+            BOOL ok = GetFileSizeEx(f, &size);
+            if (!ok) {
+                CloseHandle(f);
+            }
+            ensure (ok);
+            n = static_cast<size_t>(size.QuadPart);
+            h = CreateFileMappingA(f, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+            CloseHandle(f);
+            ensure (h != nullptr);
+            p = static_cast<char*>(MapViewOfFile(h, FILE_MAP_COPY, 0, 0, 0));
+            if (!p) {
+                CloseHandle(h);
+            }
+            ensure (p != nullptr);
+#else
+            int fd = open(file, O_RDONLY);
+            ensure (fd != -1);
+            struct stat st;
+            int s = fstat(fd, &st);
+            if (s != 0) {
+                close(fd);
+            }
+            ensure (s == 0);
+            n = static_cast<size_t>(st.st_size);
+            void* q = mmap(nullptr, n, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            close(fd);
+            ensure (q != MAP_FAILED);
+            p = static_cast<char*>(q);
+#endif
+        }
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+        ~mapped_file()
+        {
+#ifdef _WIN32
+            UnmapViewOfFile(p);
+            CloseHandle(h);
+#else
+            munmap(p, n);
+#endif
+        }
+
+        size_t size() const { return n; }
+        char* data() const { return p; }
+
+        const binary::header& header() const
+        {
+            return *reinterpret_cast<const binary::header*>(p);
+        }
+
+        template<class T = double, class F = double>
+        pwflat::curve<T,F> curve() const
+        {
+            check(type::curve, sizeof(T), sizeof(F));
+
+            size_t n_ = static_cast<size_t>(header().n);
+            size_t ot = bytes<binary::header>(1);
+            size_t of = next<T>(ot, n_);
+            size_t o_f = next<F>(of, n_);
+            next<F>(o_f, 1);
+            T* t = reinterpret_cast<T*>(p + ot);
+            F* f = reinterpret_cast<F*>(p + of);
+            F* _f = reinterpret_cast<F*>(p + o_f);
+
+            return pwflat::curve<T,F>(n_, t, f, *_f);
+        }
+
+        template<class U = double, class C = double>
+        fixed_income::portfolio<U,C> portfolio() const
+        {
+            check(type::portfolio, sizeof(U), sizeof(C));
+
+            size_t n_ = static_cast<size_t>(header().n);
+            size_t m_ = static_cast<size_t>(header().m);
+            ensure (n_ < n); // n_ + 1 does not overflow
+            size_t oo = bytes<binary::header>(1);
+            size_t ou = next<size_t>(oo, n_ + 1);
+            size_t oc = next<U>(ou, m_);
+            next<C>(oc, m_);
+            const size_t* o = reinterpret_cast<const size_t*>(p + oo);
+            const U* u = reinterpret_cast<const U*>(p + ou);
+            const C* c = reinterpret_cast<const C*>(p + oc);
+            ensure (o[0] == 0);
+            for (size_t j = 0; j < n_; ++j) {
+                ensure (o[j] <= o[j + 1]);
+            }
+            ensure (o[n_] == m_);
+
+            return fixed_income::portfolio<U,C>(n_, o, u, c);
+        }
+
+    private:
+        void check(type t, size_t time_size, size_t cash_size) const
+        {
+            ensure (n >= sizeof(binary::header));
+            const binary::header& h = header();
+            ensure (std::memcmp(h.magic, magic, sizeof(magic)) == 0);
+            ensure (h.version == version);
+            ensure (h.type == static_cast<uint32_t>(t));
+            ensure (h.time_size == time_size && h.cash_size == cash_size);
+        }
+        // offset past an array of k X's starting at offset i that fits in the file
+        template<class X>
+        size_t next(size_t i, size_t k) const
+        {
+            ensure (i <= n);
+            ensure (k <= (n - i)/sizeof(X));
+            ensure (bytes<X>(k) <= n - i);
+
+            return i + bytes<X>(k);
+        }
+    };
+
+} // fms::binary
@@ -1,8 +1,11 @@
 // fms_black.h - Black forward value and greeks.
 #pragma once
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <type_traits>
 #include "fms_prob.h"
-#include "fms_root1d_newton.h"
+#include "fms_simd.h"
 #include "../xll12/xll/ensure.h"
 
 namespace fms::black {
@@ -30,6 +33,8 @@ namespace fms::black {
     template<class F = double, class S = double, class K = double>
     inline auto value(F f, S s, K k)
     {
+        using X = std::common_type_t<F, S, K>;
+
         ensure(f >= 0);
         ensure(s >= 0);
         ensure(k >= 0);
@@ -37,20 +42,20 @@ namespace fms::black {
         // If f = 0 then F = 0 so E max{k - F, 0} = k.
         // Note 1 + f == 1 is equivalent to fabs(f) < machine epsilon.
         if (1 + f == 1) {
-            return k;
+            return X(k);
         }
 
         if (1 + k == 1) {
-            return K(0);
+            return X(0);
         }
 
-        if (1 + s == 0) {
-            return std::max(k - f, F(0));
+        if (1 + s == 1) {
+            return std::max(X(k - f), X(0));
         }
 
         auto z = moneyness(f, s, k);
 
-        return k * prob::normal_cdf(z) - f * prob::normal_cdf(z - s);
+        return X(k * prob::normal_cdf(z) - f * prob::normal_cdf(z - s));
     }
     // Black forward put value with standard parameterization.
     template<class F = double, class S = double, class K = double, class T = double>
@@ -66,25 +71,27 @@ namespace fms::black {
     template<class F = double, class S = double, class K = double>
     inline auto delta(F f, S s, K k)
     {
+        using X = std::common_type_t<F, S, K>;
+
         ensure(f >= 0);
         ensure(s >= 0);
         ensure(k >= 0);
 
         if (1 + k == 1) {
-            return K(0);
+            return X(0);
         }
 
         if (1 + f == 1) {
-            return F(-1);
+            return X(-1);
         }
 
-        if (1 + s == 0) {
-            return k == f ? S(0.5) : S(-1 * (k <= f));
+        if (1 + s == 1) {
+            return k == f ? X(-0.5) : X(-1 * (f < k));
         }
 
         auto z = moneyness(f, s, k);
 
-        return  -prob::normal_cdf(z - s);
+        return X(-prob::normal_cdf(z - s));
     }
     template<class F = double, class S = double, class K = double, class T = double>
     inline auto delta(F f, S sigma, K k, T t)
@@ -96,40 +103,493 @@ namespace fms::black {
     template<class F, class S, class K, class T>
     inline auto vega(F f, S sigma, K k, T t)
     {
+        using X = std::common_type_t<F, S, K, T>;
+
         ensure(f >= 0);
         ensure(sigma >= 0);
         ensure(k >= 0);
         ensure(t >= 0);
 
         if (1 + f == 1) {
-            return F(0);
+            return X(0);
         }
 
         if (1 + k == 1) {
-            return K(0);
+            return X(0);
         }
 
-        if (1 + t == 0) {
-            return T(0);
+        if (1 + t == 1) {
+            return X(0);
         }
 
         auto sqt = sqrt(t);
         auto s = sigma * sqt;
         auto z = moneyness(f, s, k);
-        auto n = prob::normal_pdf(z);
+        // d/ds v = k phi(z) dz/ds - f phi(z - s) (dz/ds - 1) = f phi(z - s) since k phi(z) = f phi(z - s)
+        auto n = prob::normal_pdf(z - s);
+
+        return X(f*n*sqt);
+    }
+    // Value and greeks of a Black forward put.
+    template<class X = double>
+    struct greeks {
+        X value;
+        X delta; // d/df
+        X gamma; // d^2/df^2
+        X vega;  // d/dsigma
+        X theta; // -d/dt, the change as time passes
+        X vanna; // d^2/df dsigma
+        X volga; // d^2/dsigma^2
+    };
+
+    // All greeks sharing moneyness, sqrt(t), and the normal cdf and pdf. Vanna and volga are 0
+    // unless second is true. Where f, k, or s is 0 to machine precision the value and delta are
+    // given by the functions above and the other greeks are 0.
+    template<class F = double, class S = double, class K = double, class T = double>
+    inline auto risk(F f, S sigma, K k, T t, bool second = false)
+    {
+        using X = std::common_type_t<F, S, K, T>;
+        ensure(f >= 0);
+        ensure(sigma >= 0);
+        ensure(k >= 0);
+        ensure(t >= 0);
+
+        greeks<X> g{};
+        X sqt = sqrt(t);
+        X s = sigma * sqt;
+        if (1 + f == 1 || 1 + k == 1 || 1 + s == 1) {
+            g.value = value(f, s, k);
+            g.delta = delta(f, s, k);
+
+            return g;
+        }
+
+        X z = moneyness(f, s, k);
+        X w = z - s;
+        X N = prob::normal_cdf(w);
+        X n = prob::normal_pdf(w); // k phi(z) = f phi(z - s)
+
+        g.value = k*prob::normal_cdf(z) - f*N;
+        g.delta = -N;
+        g.gamma = n/(f*s);
+        g.vega = f*n*sqt;
+        g.theta = -f*n*sigma/(2*sqt);
+        if (second) {
+            g.vanna = n*z/sigma;
+            g.volga = g.vega*w*z/sigma;
+        }
+
+        return g;
+    }
+
+    // Batch versions over arrays, e.g., option chains. Elements where f, k, or s is 0 to
+    // machine precision use the scalar functions so edge cases are handled identically.
+    // The log and normal cdf use the fms::simd kernels on blocks of the arrays.
+    constexpr size_t block = 64;
+
+    // z[i] = moneyness(f[i], s[i], k[i]) for i < m
+    template<class X>
+    inline void moneyness(size_t m, const X* f, const X* s, const X* k, X* z)
+    {
+        for (size_t i = 0; i < m; ++i) {
+            z[i] = k[i]/f[i];
+        }
+        simd::log(m, z, z);
+        for (size_t i = 0; i < m; ++i) {
+            z[i] = s[i]/2 + z[i]/s[i];
+        }
+    }
+
+    // v[i] = value(f[i], s[i], k[i])
+    template<class X>
+    inline void value(size_t n, const X* f, const X* s, const X* k, X* v)
+    {
+        X z[block], N1[block], N2[block];
+
+        for (size_t i0 = 0; i0 < n; i0 += block) {
+            size_t m = std::min(block, n - i0);
+            const X* f_ = f + i0;
+            const X* s_ = s + i0;
+            const X* k_ = k + i0;
+            X* v_ = v + i0;
+
+            moneyness(m, f_, s_, k_, z);
+            for (size_t i = 0; i < m; ++i) {
+                N2[i] = z[i] - s_[i];
+            }
+            simd::normal_cdf(m, z, N1);
+            simd::normal_cdf(m, N2, N2);
+            for (size_t i = 0; i < m; ++i) {
+                v_[i] = k_[i] * N1[i] - f_[i] * N2[i];
+            }
+
+            for (size_t i = 0; i < m; ++i) {
+                if (!(f_[i] > 0 && s_[i] > 0 && k_[i] > 0) || 1 + f_[i] == 1 || 1 + s_[i] == 1 || 1 + k_[i] == 1) {
+                    v_[i] = value(f_[i], s_[i], k_[i]);
+                }
+            }
+        }
+    }
+    // v[i] = value(f[i], sigma[i], k[i], t[i])
+    template<class X>
+    inline void value(size_t n, const X* f, const X* sigma, const X* k, const X* t, X* v)
+    {
+        X s[block];
+
+        for (size_t i0 = 0; i0 < n; i0 += block) {
+            size_t m = std::min(block, n - i0);
+
+            for (size_t i = 0; i < m; ++i) {
+                ensure(t[i0 + i] >= 0);
+                s[i] = sigma[i0 + i]*sqrt(t[i0 + i]);
+            }
+            value(m, f + i0, s, k + i0, v + i0);
+        }
+    }
+
+    // d[i] = delta(f[i], s[i], k[i])
+    template<class X>
+    inline void delta(size_t n, const X* f, const X* s, const X* k, X* d)
+    {
+        X z[block];
+
+        for (size_t i0 = 0; i0 < n; i0 += block) {
+            size_t m = std::min(block, n - i0);
+            const X* f_ = f + i0;
+            const X* s_ = s + i0;
+            const X* k_ = k + i0;
+            X* d_ = d + i0;
+
+            moneyness(m, f_, s_, k_, z);
+            for (size_t i = 0; i < m; ++i) {
+                z[i] -= s_[i];
+            }
+            simd::normal_cdf(m, z, d_);
+            for (size_t i = 0; i < m; ++i) {
+                d_[i] = -d_[i];
+            }
+
+            for (size_t i = 0; i < m; ++i) {
+                if (!(f_[i] > 0 && s_[i] > 0 && k_[i] > 0) || 1 + f_[i] == 1 || 1 + s_[i] == 1 || 1 + k_[i] == 1) {
+                    d_[i] = delta(f_[i], s_[i], k_[i]);
+                }
+            }
+        }
+    }
+    // d[i] = delta(f[i], sigma[i], k[i], t[i])
+    template<class X>
+    inline void delta(size_t n, const X* f, const X* sigma, const X* k, const X* t, X* d)
+    {
+        X s[block];
+
+        for (size_t i0 = 0; i0 < n; i0 += block) {
+            size_t m = std::min(block, n - i0);
+
+            for (size_t i = 0; i < m; ++i) {
+                s[i] = sigma[i0 + i]*sqrt(t[i0 + i]);
+            }
+            delta(m, f + i0, s, k + i0, d + i0);
+        }
+    }
+
+    // g[i] = vega(f[i], sigma[i], k[i], t[i])
+    template<class X>
+    inline void vega(size_t n, const X* f, const X* sigma, const X* k, const X* t, X* g)
+    {
+        X s[block], z[block];
+
+        for (size_t i0 = 0; i0 < n; i0 += block) {
+            size_t m = std::min(block, n - i0);
+            const X* f_ = f + i0;
+            const X* sigma_ = sigma + i0;
+            const X* k_ = k + i0;
+            const X* t_ = t + i0;
+            X* g_ = g + i0;
+
+            for (size_t i = 0; i < m; ++i) {
+                s[i] = sigma_[i]*sqrt(t_[i]);
+            }
+            moneyness(m, f_, s, k_, z);
+            for (size_t i = 0; i < m; ++i) {
+                z[i] -= s[i];
+            }
+            simd::normal_pdf(m, z, z);
+            for (size_t i = 0; i < m; ++i) {
+                g_[i] = f_[i]*z[i]*sqrt(t_[i]);
+            }
 
-        return f*n*sqt;
+            for (size_t i = 0; i < m; ++i) {
+                if (!(f_[i] > 0 && sigma_[i] >= 0 && k_[i] > 0 && t_[i] > 0) || 1 + f_[i] == 1 || 1 + k_[i] == 1 || 1 + t_[i] == 1) {
+                    g_[i] = vega(f_[i], sigma_[i], k_[i], t_[i]);
+                }
+            }
+        }
     }
+
+    // g[i] = risk(f[i], sigma[i], k[i], t[i], second)
+    template<class X>
+    inline void risk(size_t n, const X* f, const X* sigma, const X* k, const X* t, greeks<X>* g, bool second = false)
+    {
+        X sqt[block], s[block], z[block], w[block], Nz[block], N[block], phi[block];
+
+        for (size_t i0 = 0; i0 < n; i0 += block) {
+            size_t m = std::min(block, n - i0);
+            const X* f_ = f + i0;
+            const X* sigma_ = sigma + i0;
+            const X* k_ = k + i0;
+            const X* t_ = t + i0;
+            greeks<X>* g_ = g + i0;
+
+            for (size_t i = 0; i < m; ++i) {
+                sqt[i] = sqrt(t_[i]);
+                s[i] = sigma_[i]*sqt[i];
+            }
+            moneyness(m, f_, s, k_, z);
+            for (size_t i = 0; i < m; ++i) {
+                w[i] = z[i] - s[i];
+            }
+            simd::normal_cdf(m, z, Nz);
+            simd::normal_cdf(m, w, N);
+            simd::normal_pdf(m, w, phi);
+            for (size_t i = 0; i < m; ++i) {
+                X fn = f_[i]*phi[i];
+                g_[i].value = k_[i]*Nz[i] - f_[i]*N[i];
+                g_[i].delta = -N[i];
+                g_[i].gamma = phi[i]/(f_[i]*s[i]);
+                g_[i].vega = fn*sqt[i];
+                g_[i].theta = -fn*sigma_[i]/(2*sqt[i]);
+                g_[i].vanna = second ? phi[i]*z[i]/sigma_[i] : X(0);
+                g_[i].volga = second ? g_[i].vega*w[i]*z[i]/sigma_[i] : X(0);
+            }
+
+            for (size_t i = 0; i < m; ++i) {
+                if (!(f_[i] > 0 && s[i] > 0 && k_[i] > 0) || 1 + f_[i] == 1 || 1 + s[i] == 1 || 1 + k_[i] == 1) {
+                    g_[i] = risk(f_[i], sigma_[i], k_[i], t_[i], second);
+                }
+            }
+        }
+    }
+
+    // Out of the money options normalized for implied volatility.
+    // A put with forward f and strike k has the same time value, v - max{k - f, 0}, as the out of the money
+    // option with log moneyness x = -|log(f/k)| <= 0. The time value divided by sqrt(f k) is
+    // b(x, s) = e^{x/2} N(x/s + s/2) - e^{-x/2} N(x/s - s/2), where s = sigma sqrt(t).
+    // b increases from 0 to e^{x/2} and is convex for s < sqrt(-2x) and concave after.
+    namespace normalized {
+
+        template<class X = double>
+        inline X value(X x, X s)
+        {
+            if (s == 0) {
+                return X(0);
+            }
+
+            X d1 = x/s + s/2;
+            X d2 = x/s - s/2;
+            // N(d1) and N(d2) nearly cancel for small x and s
+            if (-x < s && -x < 1) {
+                return sinh(x/2) + (exp(x/2)*erf(d1/X(prob::sqrt2)) - exp(-x/2)*erf(d2/X(prob::sqrt2)))/2;
+            }
+
+            return exp(x/2)*prob::normal_cdf(d1) - exp(-x/2)*prob::normal_cdf(d2);
+        }
+
+        // e^{x/2} - b(x, s) without cancellation
+        template<class X = double>
+        inline X complement(X x, X s)
+        {
+            if (s == 0) {
+                return exp(x/2);
+            }
+
+            X d1 = x/s + s/2;
+            X d2 = x/s - s/2;
+
+            return exp(x/2)*prob::normal_cdf(-d1) + exp(-x/2)*prob::normal_cdf(d2);
+        }
+
+        // db/ds = e^{x/2} phi(x/s + s/2) and d^2b/ds^2 = db/ds (x^2/s^3 - s/4)
+        template<class X = double>
+        inline X vega(X x, X s)
+        {
+            return exp(-x*x/(2*s*s) - s*s/8)*X(prob::sqrt1_2pi);
+        }
+
+        // Solve b(x, s) = b for s. The tangents at the inflection point split the range of b in three.
+        // Below, the initial guess inverts b ~ phi s^3/x^2 and Halley's method is applied to 1/log(b).
+        // Above, the guess inverts e^{x/2} - b ~ 4 phi/s and the method is applied to log(e^{x/2} - b).
+        // In the middle, the guess is cubic Hermite interpolation of s as a function of b.
+        // Steps leaving the bracket of the root fall back to Newton, then bisection.
+        // Typically 2 or 3 iterations, the last one a correction at machine precision.
+        template<class X = double>
+        inline X implied(X x, X b, size_t* n = nullptr)
+        {
+            X b_max = exp(x/2);
+            ensure (x <= 0);
+            ensure (b >= 0);
+            ensure (b < b_max);
+
+            if (n) {
+                *n = 0;
+            }
+            if (b == 0) {
+                return X(0);
+            }
+
+            X sc = sqrt(-2*x);
+            X bc = value(x, sc);
+            X vc = x == 0 ? X(prob::sqrt1_2pi) : vega(x, sc);
+            X sl = sc - bc/vc;
+            X su = sc + (b_max - bc)/vc;
+            X bl = value(x, sl);
+            X bu = value(x, su);
+            X ln_sqrt2pi = -log(X(prob::sqrt1_2pi));
+
+            enum { lower, middle, upper } region;
+            X lo = 0, hi = std::numeric_limits<X>::infinity();
+            X s, lb = 0, lc = 0;
+            if (b < bl) {
+                region = lower;
+                hi = sl;
+                lb = log(b);
+                // b = phi(x/s) s^3/(x^2 - s^4/4) to leading order
+                s = sl;
+                for (int j = 0; j < 3; ++j) {
+                    X a = -lb - ln_sqrt2pi + 3*log(s) - 2*log(-x) - s*s/8 - log(1 - s*s*s*s/(4*x*x));
+                    X s_ = -x/sqrt(2*a);
+                    if (!(a > 0 && s_ > 0 && s_ < sl)) {
+                        break;
+                    }
+                    s = s_;
+                }
+            }
+            else if (b > bu) {
+                region = upper;
+                lo = su;
+                lc = log(b_max - b);
+                // e^{x/2} - b = phi(x/s) s/(s^2/4 - x^2/s^2) to leading order
+                s = su;
+                for (int j = 0; j < 3; ++j) {
+                    X a = -lc - ln_sqrt2pi - x*x/(2*s*s) + log(s) - log(s*s/4 - x*x/(s*s));
+                    X s_ = sqrt(8*a);
+                    if (!(a > 0 && s_ > su)) {
+                        break;
+                    }
+                    s = s_;
+                }
+            }
+            else {
+                region = middle;
+                lo = sl;
+                hi = su;
+                // ds/db = 1/vega at the ends
+                X b0 = bl, b1 = bc, s0 = sl, s1 = sc, m0 = 1/vega(x, sl), m1 = 1/vc;
+                if (b > bc) {
+                    b0 = bc; b1 = bu; s0 = sc; s1 = su; m0 = 1/vc; m1 = 1/vega(x, su);
+                }
+                if (x == 0) {
+                    m0 = 1/X(prob::sqrt1_2pi);
+                }
+                X h = b1 - b0;
+                X u = (b - b0)/h;
+                s = (1 + 2*u)*(1 - u)*(1 - u)*s0 + u*(1 - u)*(1 - u)*h*m0 + u*u*(3 - 2*u)*s1 + u*u*(u - 1)*h*m1;
+                if (!(s > lo && s < hi)) {
+                    s = (lo + hi)/2;
+                }
+            }
+
+            // Halley steps less than tol are accurate to machine precision
+            X tol = cbrt(std::numeric_limits<X>::epsilon());
+            size_t i = 0;
+            bool done = false;
+            while (!done) {
+                ensure (++i <= 32);
+
+                X v = vega(x, s);
+                X v2 = v*(x*x/(s*s*s) - s/4);
+                X g, g1, g2;
+                if (region == lower) {
+                    X b_ = value(x, s);
+                    X L = log(b_);
+                    X q = v/(b_*L);
+                    g = 1/L - 1/lb;
+                    g1 = -q/L;
+                    g2 = -(v2/(b_*L*L) - q*q - 2*q*q/L);
+                    (b_ < b ? lo : hi) = s;
+                }
+                else if (region == upper) {
+                    X c = complement(x, s);
+                    g = log(c) - lc;
+                    g1 = -v/c;
+                    g2 = -(v2*c + v*v)/(c*c);
+                    (g > 0 ? lo : hi) = s;
+                }
+                else {
+                    g = value(x, s) - b;
+                    g1 = v;
+                    g2 = v2;
+                    (g < 0 ? lo : hi) = s;
+                }
+                if (g == 0) {
+                    break;
+                }
+
+                X ds = -g/g1;
+                X d = 1 + ds*g2/(2*g1);
+                X s_ = s + (d > X(0.5) ? ds/d : ds);
+                if (fabs(s_ - s) <= tol*s) {
+                    done = true;
+                }
+                else if (!(s_ >= lo && s_ <= hi)) {
+                    s_ = s + ds;
+                    if (!(s_ >= lo && s_ <= hi)) {
+                        s_ = hi == std::numeric_limits<X>::infinity() ? 2*s : (lo + hi)/2;
+                    }
+                }
+                s = s_;
+            }
+            if (n) {
+                *n = i;
+            }
+
+            return s;
+        }
+
+    } // normalized
+
     // Find Black put volatility with value v.
+    // If n is not null it is set to the number of iterations used.
     template<class F, class V, class K, class T>
-    inline auto implied(F f, V v, K k, T t)
+    inline V implied(F f, V v, K k, T t, size_t* n = nullptr)
     {
-        V s0 = V(.2);
-        std::function<V(V)> p = [f,v,k,t](V s) { return -v + value(f, s, k, t); }; 
-        std::function<V(V)> dp = [f,k,t](V s) { return vega(f, s, k, t); };
-        root1d::newton_solver<V, V> solver(s0, p, dp);
+        ensure (f > 0);
+        ensure (k > 0);
+        ensure (t > 0);
+
+        V x = -fabs(log(f/k));
+        V b = (v - std::max(k - f, K(0)))/sqrt(f*k);
 
-        return solver.solve(); 
+        return normalized::implied(x, b, n)/sqrt(t);
+    }
+
+    // Implied volatilities of a chain of puts. Nonpositive or NaN f, k, or t and values
+    // outside the no arbitrage bounds max{k - f, 0} <= v < k give NaN instead of throwing.
+    // The bounds are checked after normalizing so values that round onto them are screened too.
+    template<class X>
+    inline void implied(size_t n, const X* f, const X* v, const X* k, const X* t, X* sigma)
+    {
+        for (size_t i = 0; i < n; ++i) {
+            sigma[i] = std::numeric_limits<X>::quiet_NaN();
+            if (!(f[i] > 0 && k[i] > 0 && t[i] > 0)) {
+                continue;
+            }
+
+            X x = -fabs(log(f[i]/k[i]));
+            X b = (v[i] - std::max(k[i] - f[i], X(0)))/sqrt(f[i]*k[i]);
+            if (b >= 0 && b < exp(x/2)) {
+                sigma[i] = normalized::implied(x, b)/sqrt(t[i]);
+            }
+        }
     }
 
 } // fms::black
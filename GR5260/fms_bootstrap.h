@@ -1,6 +1,8 @@
 // fms_bootstrap.h - Bootstrap a piecewise flat forward curve.
 #pragma once
+#include <cmath>
 #include <limits>
+#include <vector>
 #include "fms_fixed_income_instrument.h"
 #include "fms_pwflat.h"
 #include "fms_root1d_newton.h"
@@ -63,9 +65,7 @@ namespace fms::pwflat {
             ensure (-pv0 == copysign(pv0, pv_)); // root is bounded
         }
 
-        root1d::newton_solver<F,F> solver(_f, pv, dpv);
-
-		_f = solver.solve();
+		_f = root1d::newton<F>::solve(_f, pv, dpv);
 
 		return std::make_pair(u_,_f);
     }
@@ -78,4 +78,210 @@ namespace fms::pwflat {
     {
         return bootstrap<U,C,T,F>(p, i.size(), i.time(), i.cash(), f.size(), f.time(), f.rate(), _f);
     }
-}
+
+    // Build a whole curve from instruments with increasing maturities and their prices.
+    // For each instrument the present value of the cash flows on the known part of the curve
+    // is computed once, so each Newton step only touches cash flows past the end of the curve.
+    // When a price changes only the curve from that instrument's segment on is rebuilt.
+    // Instruments are not owned and must outlive the builder.
+    template<class U = double, class C = double, class T = double, class F = double>
+    class curve_builder {
+        std::vector<const fixed_income::instrument<U,C>*> i;
+        std::vector<F> p;
+        std::vector<size_t> i0; // first cash flow past the end of the curve
+        std::vector<F> pv0;     // present value of cash flows before i0
+        std::vector<F> D0;      // discount to the end of the curve
+        std::vector<T> t;
+        std::vector<F> f;
+    public:
+        curve_builder()
+        { }
+        curve_builder(size_t n, const fixed_income::instrument<U,C>* const* i_, const F* p_)
+        {
+            for (size_t k = 0; k < n; ++k) {
+                add(*i_[k], p_[k]);
+            }
+        }
+
+        // Add an instrument maturing past the end of the curve and extend the curve.
+        curve_builder& add(const fixed_income::instrument<U,C>& i_, F p_)
+        {
+            i.push_back(&i_);
+            p.push_back(p_);
+            i0.push_back(0);
+            pv0.push_back(F(0));
+            D0.push_back(F(1));
+            try {
+                extend();
+            }
+            catch (...) {
+                i.pop_back();
+                p.pop_back();
+                i0.pop_back();
+                pv0.pop_back();
+                D0.pop_back();
+
+                throw;
+            }
+
+            return *this;
+        }
+
+        // Change the price of instrument k and rebuild the curve from segment k on.
+        // The known part of the curve for instrument k is unchanged so its cached values are reused.
+        curve_builder& update(size_t k, F p_)
+        {
+            ensure (k < p.size());
+
+            p[k] = p_;
+            if (k < t.size()) {
+                t.resize(k);
+                f.resize(k);
+                solve();
+            }
+            while (t.size() < i.size()) {
+                extend();
+            }
+
+            return *this;
+        }
+        // Replace instrument k, e.g., when its quote changes, and rebuild the curve from segment k on.
+        curve_builder& update(size_t k, const fixed_income::instrument<U,C>& i_, F p_)
+        {
+            ensure (k < p.size());
+
+            i[k] = &i_;
+            p[k] = p_;
+            if (k < t.size()) {
+                t.resize(k);
+                f.resize(k);
+            }
+            while (t.size() < i.size()) {
+                extend();
+            }
+
+            return *this;
+        }
+
+        // Replace instruments k[l] for l < n, e.g., a burst of quotes, and rebuild the curve
+        // once from the first segment changed.
+        curve_builder& update(size_t n, const size_t* k, const fixed_income::instrument<U,C>* const* i_, const F* p_)
+        {
+            size_t k0 = i.size();
+            for (size_t l = 0; l < n; ++l) {
+                ensure (k[l] < p.size());
+
+                i[k[l]] = i_[l];
+                p[k[l]] = p_[l];
+                k0 = std::min(k0, k[l]);
+            }
+            if (k0 < t.size()) {
+                t.resize(k0);
+                f.resize(k0);
+            }
+            while (t.size() < i.size()) {
+                extend();
+            }
+
+            return *this;
+        }
+
+        size_t size() const { return t.size(); }
+        const T* time() const { return t.data(); }
+        T* time() { return t.data(); }
+        const F* rate() const { return f.data(); }
+        F* rate() { return f.data(); }
+
+        const fixed_income::instrument<U,C>& instrument(size_t k) const { return *i[k]; }
+        const F& price(size_t k) const { return p[k]; }
+
+    private:
+        // Cache the known part of instrument size() and solve for the next forward.
+        void extend()
+        {
+            size_t k = t.size();
+            size_t m = i[k]->size();
+            const U* u = i[k]->time();
+            const C* c = i[k]->cash();
+
+            // end of curve
+            T t_ = k == 0 ? T(0) : t[k - 1];
+
+            ensure (m > 0);
+            ensure (u[m - 1] > t_);
+
+            i0[k] = std::upper_bound(u, u + m, t_) - u;
+            pv0[k] = present_value(i0[k], u, c, k, t.data(), f.data());
+            D0[k] = k == 0 ? F(1) : unchecked::discount(t_, k, t.data(), f.data());
+
+            solve();
+        }
+
+        // Solve for the forward past the end of the curve that reprices instrument size().
+        void solve()
+        {
+            size_t k = t.size();
+            size_t m = i[k]->size();
+            const U* u = i[k]->time();
+            const C* c = i[k]->cash();
+            T t_ = k == 0 ? T(0) : t[k - 1];
+            F D_ = D0[k];
+            F p_ = p[k] - pv0[k];
+            size_t j = i0[k];
+            F _f;
+
+            if (j + 1 == m) {
+                // p = pv0 + c D exp(-f(u - t))
+                _f = -log(p_/(c[j]*D_))/(u[j] - t_);
+            }
+            else if (j + 2 == m && p_ == 0) {
+                // 0 = c0 exp(-f(u0 - t)) + c1 exp(-f(u1 - t))
+                _f = log(-c[j]/c[j + 1])/(u[j] - u[j + 1]);
+            }
+            else {
+                const std::function<F(F)> pv = [=](F f_) {
+                    F s{ 0 };
+                    for (size_t l = j; l < m; ++l) {
+                        s += c[l] * exp(-f_ * (u[l] - t_));
+                    }
+
+                    return D_ * s - p_;
+                };
+                const std::function<F(F)> dpv = [=](F f_) {
+                    F s{ 0 };
+                    for (size_t l = j; l < m; ++l) {
+                        s -= (u[l] - t_) * c[l] * exp(-f_ * (u[l] - t_));
+                    }
+
+                    return D_ * s;
+                };
+
+                _f = k == 0 ? F(0) : f[k - 1];
+
+                // Start with [0, 10 f] like bootstrap and widen it if forwards change sign.
+                // Newton steps leaving the bracket bisect.
+                F a = _f < 0 ? 10*_f : F(0);
+                F b = _f < 0 ? F(0) : 10*_f;
+                F w = b - a == 0 ? F(0.1) : b - a;
+                F pv0_ = pv(a);
+                F pv_ = pv(b);
+                for (size_t l = 0; l < 8 && -pv0_ != copysign(pv0_, pv_); ++l) {
+                    a -= w;
+                    b += w;
+                    w *= 2;
+                    pv0_ = pv(a);
+                    pv_ = pv(b);
+                }
+                ensure (-pv0_ == copysign(pv0_, pv_)); // root is bounded
+
+                _f = root1d::newton<F>::solve(_f, pv, dpv, a, b);
+            }
+            ensure (fabs(_f) < F(std::numeric_limits<T>::infinity())); // closed forms give NaN if no forward reprices
+
+            t.push_back(u[m - 1]);
+            f.push_back(_f);
+        }
+    };
+
+} // fms::pwflat
+
@@ -34,5 +34,96 @@ namespace fms {
             return black::delta(f, sigma, k, t);
         }
 
+        // Black-Scholes/Merton put value and greeks with respect to s, sigma, and t.
+        // With D = exp(-rt) and f = s/D the Black greeks scale by D except
+        // d/ds = d/df, d^2/ds^2 = d^2/df^2 / D, and
+        // -d/dt D v_B(f, sigma, k, t) = D(r v_B - r f d/df v_B - d/dt v_B).
+        template<class R = double, class F = double, class S = double, class K = double, class T = double>
+        inline auto risk(R r, F s, S sigma, K k, T t, bool second = false)
+        {
+            auto D = exp(-r * t);
+            auto g = black::risk(s / D, sigma, k, t, second);
+
+            g.theta = D * (r * g.value - r * (s / D) * g.delta + g.theta);
+            g.value *= D;
+            g.gamma /= D;
+            g.vega *= D;
+            g.volga *= D;
+
+            return g;
+        }
+
+        // Batch versions over arrays using black:: batch functions.
+        // v[i] = value(r[i], s[i], sigma[i], k[i], t[i])
+        template<class X>
+        inline void value(size_t n, const X* r, const X* s, const X* sigma, const X* k, const X* t, X* v)
+        {
+            X D[black::block], f[black::block];
+
+            for (size_t i0 = 0; i0 < n; i0 += black::block) {
+                size_t m = std::min(black::block, n - i0);
+
+                for (size_t i = 0; i < m; ++i) {
+                    D[i] = -r[i0 + i] * t[i0 + i];
+                }
+                simd::exp(m, D, D);
+                for (size_t i = 0; i < m; ++i) {
+                    f[i] = s[i0 + i] / D[i];
+                }
+                black::value(m, f, sigma + i0, k + i0, t + i0, v + i0);
+                for (size_t i = 0; i < m; ++i) {
+                    v[i0 + i] *= D[i];
+                }
+            }
+        }
+
+        // d[i] = delta(r[i], s[i], sigma[i], k[i], t[i])
+        template<class X>
+        inline void delta(size_t n, const X* r, const X* s, const X* sigma, const X* k, const X* t, X* d)
+        {
+            X f[black::block];
+
+            for (size_t i0 = 0; i0 < n; i0 += black::block) {
+                size_t m = std::min(black::block, n - i0);
+
+                for (size_t i = 0; i < m; ++i) {
+                    f[i] = r[i0 + i] * t[i0 + i];
+                }
+                simd::exp(m, f, f);
+                for (size_t i = 0; i < m; ++i) {
+                    f[i] *= s[i0 + i];
+                }
+                black::delta(m, f, sigma + i0, k + i0, t + i0, d + i0);
+            }
+        }
+
+        // g[i] = risk(r[i], s[i], sigma[i], k[i], t[i], second)
+        template<class X>
+        inline void risk(size_t n, const X* r, const X* s, const X* sigma, const X* k, const X* t, black::greeks<X>* g, bool second = false)
+        {
+            X D[black::block], f[black::block];
+
+            for (size_t i0 = 0; i0 < n; i0 += black::block) {
+                size_t m = std::min(black::block, n - i0);
+
+                for (size_t i = 0; i < m; ++i) {
+                    D[i] = -r[i0 + i] * t[i0 + i];
+                }
+                simd::exp(m, D, D);
+                for (size_t i = 0; i < m; ++i) {
+                    f[i] = s[i0 + i] / D[i];
+                }
+                black::risk(m, f, sigma + i0, k + i0, t + i0, g + i0, second);
+                for (size_t i = 0; i < m; ++i) {
+                    black::greeks<X>& g_ = g[i0 + i];
+                    g_.theta = D[i] * (r[i0 + i] * g_.value - r[i0 + i] * f[i] * g_.delta + g_.theta);
+                    g_.value *= D[i];
+                    g_.gamma /= D[i];
+                    g_.vega *= D[i];
+                    g_.volga *= D[i];
+                }
+            }
+        }
+
     } // bsm
 } // fms
\ No newline at end of file
@@ -17,7 +17,7 @@ namespace fms::fixed_income {
             t[0] = u;
             c[0] = -1;
             t[1] = v;
-            c[1] = 1 + f*(u - v);
+            c[1] = 1 + f*(v - u);
         }
     private:
         size_t _size() const override 
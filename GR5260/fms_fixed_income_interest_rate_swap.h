@@ -5,8 +5,10 @@
 // C_n = 1 + r*/f
 #pragma once
 #include <functional>
+#include <memory>
 #include <vector>
 #include "fms_fixed_income_instrument.h"
+#include "fms_fixed_income_swap_schedule.h"
 
 namespace fms::fixed_income {
 
@@ -15,30 +17,35 @@ namespace fms::fixed_income {
         U u;
         C r;
         frequency q;
-        std::vector<U> t;
+        std::shared_ptr<const swap_schedule<U>> s;
         std::vector<C> c;
     public:
         interest_rate_swap(U u, C r, frequency q)
-            : u(u), r(r), q(q), t(static_cast<size_t>(1 + static_cast<U>(q)*u)), c(static_cast<size_t>(1 + static_cast<U>(q)*u))
+            : interest_rate_swap(std::make_shared<const swap_schedule<U>>(u, q), r)
+        { }
+        // use a schedule shared with other swaps, e.g., from swap_schedule_cache
+        interest_rate_swap(const std::shared_ptr<const swap_schedule<U>>& s, C r)
+            : u(s->time()[s->size() - 1]), r(r), q(s->freq()), s(s), c(s->size())
         {
-            U dt = static_cast<U>(q);
-            dt = 1/dt;
-            t[0] = 0;
+            const U* dt = s->accrual();
             c[0] = -1;
-            for (size_t i = 1; i < t.size(); ++i) {
-                t[i] = i*dt;
-                c[i] = r*dt;
+            for (size_t i = 1; i < c.size(); ++i) {
+                c[i] = r*dt[i];
             }
             c.back() += 1;
         }
+
+        C coupon() const { return r; }
+        frequency freq() const { return q; }
+        const std::shared_ptr<const swap_schedule<U>>& schedule() const { return s; }
     private:
         size_t _size() const override 
         {
-            return t.size();
+            return s->size();
         }
         const U* _time() const override 
         { 
-            return t.data(); 
+            return s->time(); 
         }
         const C* _cash() const override 
         { 
@@ -47,8 +54,9 @@ namespace fms::fixed_income {
     };
 
     // F^delta(t_0,...,t_n) = (D(t_0) - D(t_n))/sum_1^n delta_j D(t_j)
-    template<class U = double, class C = double>
-    inline C par_coupon(const interest_rate_swap<U,C>& irs, const std::function<C(U)>& D)
+    // D is any callable, e.g., a lambda or std::function<C(U)>.
+    template<class U = double, class C = double, class Disc = std::function<C(U)>>
+    inline C par_coupon(const interest_rate_swap<U,C>& irs, const Disc& D)
     {
         C sum = C(0);
         const U* u = irs.time();
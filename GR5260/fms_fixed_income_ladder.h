@@ -0,0 +1,86 @@
+// fms_fixed_income_ladder.h - net cash flows of many instruments on distinct sorted times
+#pragma once
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "fms_fixed_income_portfolio.h"
+
+namespace fms::fixed_income {
+
+    // Cash flows of a set of instruments summed on each distinct time.
+    // The present value of the ladder is the total present value of the instruments
+    // and takes one discount per distinct time, so build it once and reuse it
+    // for every curve scenario.
+    template<class U = double, class C = double>
+    class ladder : public instrument<U,C> {
+        size_t m; // number of cash flows before netting
+        std::vector<U> u;
+        std::vector<C> c;
+    public:
+        ladder()
+            : m(0)
+        { }
+        // net cash flows of a range of instruments
+        template<class I>
+        ladder(I b, I e)
+            : m(0)
+        {
+            std::vector<std::pair<U,C>> uc;
+            for (; b != e; ++b) {
+                const instrument<U,C>& i = *b;
+                for (size_t j = 0; j < i.size(); ++j) {
+                    uc.emplace_back(i.time()[j], i.cash()[j]);
+                }
+            }
+            net(uc);
+        }
+        ladder(const portfolio<U,C>& P)
+            : m(0)
+        {
+            std::vector<std::pair<U,C>> uc(P.cash_flows());
+            for (size_t l = 0; l < uc.size(); ++l) {
+                uc[l] = std::make_pair(P.time()[l], P.cash()[l]);
+            }
+            net(uc);
+        }
+
+        // number of cash flows before netting
+        size_t cash_flows() const { return m; }
+
+    private:
+        // stable sort keeps summation in instrument order for equal times
+        void net(std::vector<std::pair<U,C>>& uc)
+        {
+            m = uc.size();
+            std::stable_sort(uc.begin(), uc.end(), [](const auto& a, const auto& b) {
+                return a.first < b.first;
+            });
+
+            u.clear();
+            c.clear();
+            for (const auto& [ui, ci] : uc) {
+                if (u.size() > 0 && u.back() == ui) {
+                    c.back() += ci;
+                }
+                else {
+                    u.push_back(ui);
+                    c.push_back(ci);
+                }
+            }
+        }
+
+        size_t _size() const override
+        {
+            return u.size();
+        }
+        const U* _time() const override
+        {
+            return u.data();
+        }
+        const C* _cash() const override
+        {
+            return c.data();
+        }
+    };
+
+} // fms::fixed_income
@@ -0,0 +1,79 @@
+// fms_fixed_income_portfolio.h - cash flows of many instruments in contiguous storage
+#pragma once
+#include <vector>
+#include "fms_fixed_income_instrument.h"
+#include "../xll12/xll/ensure.h"
+
+namespace fms::fixed_income {
+
+    // Structure of arrays for a book of instruments.
+    // Instrument k has cash flows c[l] at times u[l] for offset[k] <= l < offset[k + 1].
+    template<class U = double, class C = double>
+    class portfolio {
+        std::vector<U> u;
+        std::vector<C> c;
+        std::vector<size_t> off;
+        // unmanaged memory
+        size_t n_;
+        const size_t* off_;
+        const U* u_;
+        const C* c_;
+    public:
+        portfolio()
+            : off(1, 0), n_(0), off_(nullptr), u_(nullptr), c_(nullptr)
+        { }
+        // For pre-allocated and unmanaged memory, e.g., a memory mapped file.
+        // Null offsets are an empty portfolio.
+        portfolio(size_t n, const size_t* off, const U* u, const C* c)
+            : off(1, 0), n_(n), off_(off), u_(u), c_(c)
+        {
+            ensure (off || n == 0);
+        }
+        // copy cash flows from a range of instruments
+        template<class I>
+        portfolio(I b, I e)
+            : portfolio()
+        {
+            for (; b != e; ++b) {
+                push_back(*b);
+            }
+        }
+
+        void reserve(size_t instruments, size_t cash_flows)
+        {
+            off.reserve(instruments + 1);
+            u.reserve(cash_flows);
+            c.reserve(cash_flows);
+        }
+
+        // append cash flows of an instrument
+        portfolio& push_back(const instrument<U,C>& i)
+        {
+            ensure (off_ == nullptr);
+
+            u.insert(u.end(), i.time(), i.time() + i.size());
+            c.insert(c.end(), i.cash(), i.cash() + i.size());
+            off.push_back(u.size());
+
+            return *this;
+        }
+
+        // number of instruments
+        size_t size() const { return off_ ? n_ : off.size() - 1; }
+        // total number of cash flows
+        size_t cash_flows() const { return offset()[size()]; }
+
+        const U* time() const { return off_ ? u_ : u.data(); }
+        const C* cash() const { return off_ ? c_ : c.data(); }
+        const size_t* offset() const { return off_ ? off_ : off.data(); }
+
+        // View of instrument k that does not own its memory.
+        instrument<U,C> operator[](size_t k) const
+        {
+            const size_t* o = offset();
+
+            return instrument<U,C>(o[k + 1] - o[k], time() + o[k], cash() + o[k]);
+        }
+    };
+
+} // fms::fixed_income
@@ -0,0 +1,80 @@
+// fms_fixed_income_swap_schedule.h - swap payment times and accrual fractions shared by swaps
+// t_j = j/f, j = 0, 1, ..., n = f*u
+// delta_j = t_j - t_{j-1}, 0 < j <= n
+#pragma once
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "fms_fixed_income_instrument.h"
+
+namespace fms::fixed_income {
+
+    template<class U = double>
+    class swap_schedule {
+        frequency q;
+        std::vector<U> t;
+        std::vector<U> dt; // dt[0] = 0
+    public:
+        // number of periods for tenor u
+        static size_t periods(U u, frequency q)
+        {
+            return static_cast<size_t>(static_cast<U>(q)*u);
+        }
+
+        swap_schedule(U u, frequency q)
+            : q(q), t(1 + periods(u, q)), dt(t.size())
+        {
+            U dt_ = static_cast<U>(q);
+            dt_ = 1/dt_;
+            t[0] = 0;
+            dt[0] = 0;
+            for (size_t i = 1; i < t.size(); ++i) {
+                t[i] = i*dt_;
+                dt[i] = dt_;
+            }
+        }
+
+        size_t size() const { return t.size(); }
+        frequency freq() const { return q; }
+        const U* time() const { return t.data(); }
+        // dt[j] is the accrual fraction for the period ending at t[j]
+        const U* accrual() const { return dt.data(); }
+    };
+
+    // Schedules keyed by (periods, frequency) so swaps having the same tenor share them.
+    // Safe to use from multiple threads.
+    template<class U = double>
+    class swap_schedule_cache {
+        std::map<std::pair<size_t, frequency>, std::shared_ptr<const swap_schedule<U>>> cache;
+        mutable std::mutex m;
+    public:
+        std::shared_ptr<const swap_schedule<U>> get(U u, frequency q)
+        {
+            auto key = std::make_pair(swap_schedule<U>::periods(u, q), q);
+            std::lock_guard<std::mutex> lock(m);
+
+            auto i = cache.find(key);
+            if (i == cache.end()) {
+                i = cache.emplace(key, std::make_shared<const swap_schedule<U>>(u, q)).first;
+            }
+
+            return i->second;
+        }
+
+        size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(m);
+
+            return cache.size();
+        }
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(m);
+
+            cache.clear();
+        }
+    };
+
+} // fms::fixed_income
@@ -0,0 +1,369 @@
+// fms_jet.h - multivariate truncated Taylor polynomials
+// A jet in V variables of degree D is x = sum_{|alpha| <= D} x_alpha h^alpha where
+// h^alpha = h_1^alpha_1 ... h_V^alpha_V and monomials of degree greater than D are 0.
+// For any analytic function f, f(x + h) = sum_{|alpha| <= D} d^alpha f(x)/alpha! h^alpha,
+// so evaluating f at x_i I + h_i gives every partial derivative up to order D.
+#pragma once
+#include <array>
+#include <compare>
+#include <limits>
+#include "fms_analytic.h"
+
+namespace fms {
+
+    // Monomials in V variables of degree at most D ordered by degree.
+    // The monomials of degree 1 are h_0, ..., h_{V-1} with indices 1, ..., V.
+    template<size_t V, size_t D>
+    class monomials {
+        static constexpr size_t choose(size_t n, size_t k)
+        {
+            size_t c = 1;
+
+            for (size_t i = 1; i <= k; ++i) {
+                c = c*(n - k + i)/i;
+            }
+
+            return c;
+        }
+        static constexpr size_t power(size_t b, size_t n)
+        {
+            size_t p = 1;
+
+            while (n--) {
+                p *= b;
+            }
+
+            return p;
+        }
+    public:
+        static constexpr size_t size = choose(V + D, D);
+        // alpha has code sum_v alpha_v (D + 1)^v
+        static constexpr size_t codes = power(D + 1, V);
+
+        std::array<std::array<size_t,V>,size> alpha;
+        std::array<size_t,size> degree;
+        std::array<size_t,size> code;
+        std::array<size_t,codes> index; // size if the degree is greater than D
+
+        constexpr monomials()
+            : alpha{}, degree{}, code{}, index{}
+        {
+            size_t i = 0;
+
+            index.fill(size);
+            for (size_t d = 0; d <= D; ++d) {
+                for (size_t c = 0; c < codes; ++c) {
+                    std::array<size_t,V> a{};
+                    size_t c_ = c, d_ = 0;
+                    for (size_t v = 0; v < V; ++v) {
+                        a[v] = c_%(D + 1);
+                        c_ /= D + 1;
+                        d_ += a[v];
+                    }
+                    if (d_ == d) {
+                        alpha[i] = a;
+                        degree[i] = d;
+                        code[i] = c;
+                        index[c] = i;
+                        ++i;
+                    }
+                }
+            }
+        }
+
+        // number of pairs with degree at most D
+        static constexpr size_t pairs()
+        {
+            size_t n = 0;
+
+            for (size_t d = 0; d <= D; ++d) {
+                for (size_t e = 0; d + e <= D; ++e) {
+                    n += choose(V - 1 + d, d)*choose(V - 1 + e, e);
+                }
+            }
+
+            return n;
+        }
+        // h^alpha_i h^alpha_j = h^alpha_k for {i, j, k}
+        constexpr std::array<std::array<size_t,3>,pairs()> products() const
+        {
+            std::array<std::array<size_t,3>,pairs()> ijk{};
+            size_t n = 0;
+
+            for (size_t i = 0; i < size; ++i) {
+                for (size_t j = 0; j < size && degree[i] + degree[j] <= D; ++j) {
+                    ijk[n++] = {i, j, index[code[i] + code[j]]};
+                }
+            }
+
+            return ijk;
+        }
+    };
+
+    // Truncated Taylor polynomial in V variables of total degree D.
+    template<class X, size_t V, size_t D>
+    class jet {
+        static constexpr monomials<V,D> m{};
+        static constexpr auto ijk = m.products();
+        static constexpr size_t M = monomials<V,D>::size;
+
+        std::array<X,M> x;
+
+        // f(a + h) = sum_k f_k h^k where f(a I + J) = sum_k f_k J^k
+        static jet compose(jet h, const analytic<X,D + 1>& f)
+        {
+            jet y(f[D]);
+
+            h.x[0] = 0;
+            for (size_t k = D; k-- > 0; ) {
+                y *= h;
+                y.x[0] += f[k];
+            }
+
+            return y;
+        }
+        // a I + J
+        static constexpr analytic<X,D + 1> J(X a)
+        {
+            return analytic<X,D + 1>{a, X(1)};
+        }
+    public:
+        // 0
+        constexpr jet()
+            : x{}
+        { }
+        // x0 I
+        constexpr jet(X x0)
+            : x{}
+        {
+            x[0] = x0;
+        }
+        // x0 I + h_i
+        static constexpr jet variable(size_t i, X x0)
+        {
+            jet y(x0);
+            y.x[1 + i] = 1;
+
+            return y;
+        }
+        // yI
+        constexpr jet& operator=(X y)
+        {
+            x = {};
+            x[0] = y;
+
+            return *this;
+        }
+
+        constexpr bool operator==(const jet& y) const
+        {
+            return x == y.x;
+        }
+        constexpr bool operator!=(const jet& y) const
+        {
+            return !operator==(y);
+        }
+        // yI
+        friend constexpr bool operator==(const jet& x, X y)
+        {
+            return x == jet(y);
+        }
+        // ordered by value for branches in pricers
+        friend constexpr auto operator<=>(const jet& x, const jet& y)
+        {
+            return x[0] <=> y[0];
+        }
+        friend constexpr auto operator<=>(const jet& x, X y)
+        {
+            return x[0] <=> y;
+        }
+
+        static constexpr size_t size()
+        {
+            return M;
+        }
+        static constexpr size_t variables()
+        {
+            return V;
+        }
+        static constexpr size_t degree()
+        {
+            return D;
+        }
+        // i-th monomial
+        static constexpr const std::array<size_t,V>& alpha(size_t i)
+        {
+            return m.alpha[i];
+        }
+        // coefficient of alpha(i)
+        constexpr X operator[](size_t i) const
+        {
+            return x[i];
+        }
+        constexpr X& operator[](size_t i)
+        {
+            return x[i];
+        }
+        // d^alpha, 0 if the degree of alpha is greater than D
+        constexpr X operator()(const std::array<size_t,V>& alpha) const
+        {
+            size_t c = 0, p = 1, d = 0;
+            X a_ = 1; // alpha!
+
+            for (size_t v = 0; v < V; ++v) {
+                d += alpha[v];
+                c += alpha[v]*p;
+                p *= D + 1;
+                a_ *= factorial(X(alpha[v]));
+            }
+
+            return d <= D ? x[m.index[c]]*a_ : X(0);
+        }
+
+        constexpr jet& operator+=(const jet& y)
+        {
+            for (size_t i = 0; i < M; ++i) {
+                x[i] += y.x[i];
+            }
+
+            return *this;
+        }
+        // non-member friend
+        friend constexpr jet operator+(jet x, const jet& y)
+        {
+            return x += y;
+        }
+        constexpr jet& operator-=(const jet& y)
+        {
+            for (size_t i = 0; i < M; ++i) {
+                x[i] -= y.x[i];
+            }
+
+            return *this;
+        }
+        // non-member friend
+        friend constexpr jet operator-(jet x, const jet& y)
+        {
+            return x -= y;
+        }
+        constexpr jet operator-() const
+        {
+            jet y;
+
+            for (size_t i = 0; i < M; ++i) {
+                y.x[i] = -x[i];
+            }
+
+            return y;
+        }
+
+        // sum_i x_i h^alpha_i sum_j y_j h^alpha_j = sum_{alpha_i + alpha_j = alpha_k} x_i y_j h^alpha_k
+        constexpr jet& operator*=(const jet& y)
+        {
+            std::array<X,M> z{};
+
+            for (const auto& [i, j, k] : ijk) {
+                z[k] += x[i]*y.x[j];
+            }
+            x = z;
+
+            return *this;
+        }
+        // non-member friend
+        friend constexpr jet operator*(jet x, const jet& y)
+        {
+            return x *= y;
+        }
+        jet& operator/=(const jet& y)
+        {
+            return *this *= compose(y, taylor::div(analytic<X,D + 1>(X(1)), J(y[0])));
+        }
+        // non-member friend
+        friend jet operator/(jet x, const jet& y)
+        {
+            return x /= y;
+        }
+
+        // scalars
+        constexpr jet& operator+=(X y)
+        {
+            x[0] += y;
+
+            return *this;
+        }
+        friend constexpr jet operator+(jet x, X y)
+        {
+            return x += y;
+        }
+        friend constexpr jet operator+(X x, jet y)
+        {
+            return y += x;
+        }
+        constexpr jet& operator-=(X y)
+        {
+            x[0] -= y;
+
+            return *this;
+        }
+        friend constexpr jet operator-(jet x, X y)
+        {
+            return x -= y;
+        }
+        friend constexpr jet operator-(X x, const jet& y)
+        {
+            return -y += x;
+        }
+        constexpr jet& operator*=(X y)
+        {
+            for (auto& xi : x) {
+                xi *= y;
+            }
+
+            return *this;
+        }
+        friend constexpr jet operator*(jet x, X y)
+        {
+            return x *= y;
+        }
+        friend constexpr jet operator*(X x, jet y)
+        {
+            return y *= x;
+        }
+        constexpr jet& operator/=(X y)
+        {
+            for (auto& xi : x) {
+                xi /= y;
+            }
+
+            return *this;
+        }
+        friend constexpr jet operator/(jet x, X y)
+        {
+            return x /= y;
+        }
+        friend jet operator/(X x, const jet& y)
+        {
+            return jet(x) /= y;
+        }
+
+        // found by argument dependent lookup, univariate series from fms::taylor
+        friend jet exp(const jet& a) { return compose(a, taylor::exp(J(a[0]))); }
+        friend jet log(const jet& a) { return compose(a, taylor::log(J(a[0]))); }
+        friend jet sqrt(const jet& a) { return compose(a, taylor::sqrt(J(a[0]))); }
+        friend jet pow(const jet& a, X p) { return compose(a, taylor::pow(J(a[0]), p)); }
+        friend jet pow(const jet& a, const jet& p) { return exp(p*log(a)); }
+        friend jet erf(const jet& a) { return compose(a, taylor::erf(J(a[0]))); }
+        friend jet erfc(const jet& a) { return compose(a, taylor::erfc(J(a[0]))); }
+    };
+
+} // fms
+
+// NaN value with zero derivatives, e.g., default arguments of fms::pwflat
+template<class X, size_t V, size_t D>
+class std::numeric_limits<fms::jet<X,V,D>> : public std::numeric_limits<X> {
+public:
+    static constexpr fms::jet<X,V,D> quiet_NaN() noexcept
+    {
+        return std::numeric_limits<X>::quiet_NaN();
+    }
+};
@@ -2,24 +2,87 @@
 #pragma once
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <cstddef>
 
 namespace fms::prob {
 
+    constexpr double sqrt2 = 1.4142135623730951;
+    constexpr double sqrt1_2pi = 0.3989422804014327; // 1/sqrt(2 pi)
+    constexpr double sqrt4_pi = 1.1283791670955126; // 2/sqrt(pi)
+
+    // Maximum absolute error of normal_cdf.
+    enum class accuracy {
+        low,    // 7.5e-8, Abramowitz and Stegun 26.2.17
+        medium, // 1e-12, truncated series in fms::simd, erf for scalars
+        full,   // 2e-16
+    };
+
+    // N(x) = 1 - phi(x) sum_k b_k t^(k+1), t = 1/(1 + p x) for x >= 0, A&S 26.2.17
+    constexpr double as_p = 0.2316419;
+    constexpr double as_coefficients[] = {
+        0.319381530, -0.356563782, 1.781477937, -1.821255978, 1.330274429,
+    };
+
+    // erf(y) = y sum_k a_k y^2k for |y| < 0.9, a_k = 2/sqrt(pi) (-1)^k/(k!(2k + 1))
+    constexpr double erf_coefficients[] = {
+        1.1283791670955126, -0.37612638903183754, 0.11283791670955126,
+        -0.026866170645131252, 0.005223977625442188, -0.0008548327023450853,
+        0.00012055332981789664, -1.492565035840625e-05, 1.6462114365889248e-06,
+        -1.6365844691234924e-07, 1.4807192815879218e-08, -1.2290555301717928e-09,
+        9.422759064650411e-11, -6.7113668551641105e-12, 4.4632242632864775e-13,
+        -2.7835162072109215e-14, 1.6342614095367152e-15, -9.063970842808673e-17,
+    };
+
+    // erfc(y) exp(y^2) = sum_k c_k T_k((y - 3.8)/(y + 2)) for y >= 0.9, Chebyshev interpolant
+    // with absolute error in erfc(y) less than 1e-16
+    constexpr double erfcx_coefficients[] = {
+        0.18571969903559193, -0.2228647467640757, 0.04224532849955019,
+        -0.005434994384656882, 0.0003074912895220631, 3.418423825895878e-05,
+        -6.83453962735046e-06, -2.731844742055612e-07, 1.448553799166129e-07,
+        4.620590531389484e-09, -3.5736074096508085e-09, -1.973748043425505e-10,
+        9.727368864694108e-11, 1.0702445372170638e-11, -2.5742654149647933e-12,
+        -5.535482532306347e-13, 4.902332541836492e-14, 2.5587994253090048e-14,
+        6.297492887510036e-16, -1.0166717605818292e-15, -1.7176362867979776e-16,
+        2.050608556730525e-18, -2.836900176268868e-17, 1.2637573457385411e-18,
+    };
+
+    // number of terms of the series used by the fms::simd kernels for each accuracy
+    template<accuracy A>
+    constexpr size_t erf_terms = A == accuracy::full ? sizeof(erf_coefficients)/sizeof(double) : 13;
+    template<accuracy A>
+    constexpr size_t erfcx_terms = A == accuracy::full ? sizeof(erfcx_coefficients)/sizeof(double) : 14;
+
     // Standard normal probability density function.
     template<class X = double>
     inline X normal_pdf(X x) noexcept
     {
-        static X sqrt2pi = sqrt(X(2*M_PI));
-
-        return exp(-x*x/2)/sqrt2pi;
+        return exp(-x*x/2)*X(sqrt1_2pi);
     }
+
     // Standard normal cumulative distribution function.
-    template<class X = double>
+    template<class X = double, accuracy A = accuracy::full>
     inline X normal_cdf(X x) noexcept
     {
-        static X sqrt2 = sqrt(X(2));
+        if constexpr (A == accuracy::low) {
+            const double* b = as_coefficients;
+            X t = 1/(1 + X(as_p)*fabs(x));
+            X q = normal_pdf(x)*t*(X(b[0]) + t*(X(b[1]) + t*(X(b[2]) + t*(X(b[3]) + t*X(b[4])))));
+
+            return x < 0 ? q : 1 - q;
+        }
+        else {
+            // the library erf is faster than the series for scalars
+            X y = x/X(sqrt2);
+
+            if (y < X(-0.9)) {
+                return erfc(-y)/2;
+            }
+            if (y > X(0.9)) {
+                return 1 - erfc(y)/2;
+            }
 
-        return X(0.5) + erf(x/sqrt2)/2;
+            return X(0.5) + erf(y)/2;
+        }
     }
 
-} // fms::prob
\ No newline at end of file
+} // fms::prob
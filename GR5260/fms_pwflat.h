@@ -4,7 +4,9 @@
 #include <algorithm> // adjacent_find
 #include <limits>    // quiet_Nan()
 #include <numeric>   // upper/lower_bound
+#include <vector>
 #include "fms_fixed_income_instrument.h"
+#include "../xll12/xll/ensure.h"
 
 inline const wchar_t* fms_pwflat_doc = LR"xyzzyx(
 Piecewise flat (constant) curves. &#8712;
@@ -37,6 +39,68 @@ namespace fms::pwflat {
         return strictly_increasing(t, t + n);
     }
 
+    // Evaluation without checking that t is strictly increasing.
+    // Use these only for curves that have already been validated.
+    // Except for discount they can be used in constant expressions.
+
+    namespace unchecked {
+
+        template<class T, class F>
+        constexpr F value(const T& u, size_t n, const T* t, const F* f, 
+            const F& _f = std::numeric_limits<F>::quiet_NaN()) noexcept
+        {
+            if (u < 0)
+                return std::numeric_limits<F>::quiet_NaN();
+
+            auto ti = std::lower_bound(t, t + n, u);
+
+            return ti == t + n ? _f : f[ti - t];
+        }
+
+        template<class T, class F>
+        constexpr F integral(const T& u, size_t n, const T* t, const F* f, 
+            const F& _f = std::numeric_limits<F>::quiet_NaN()) noexcept
+        {
+            if (u < 0)
+                return std::numeric_limits<F>::quiet_NaN();
+
+            F I{ 0 };
+            T t_{ 0 };
+
+            size_t i = 0;
+            for (; i < n && t[i] <= u; ++i) {
+                I += f[i] * (t[i] - t_);
+                t_ = t[i];
+            }
+            if (i < n) {
+                I += f[i] * (u - t_);
+            }
+            else if (n == 0 || u > t_) {
+                I += _f * (u - t_);
+            }
+
+            return I;
+        }
+
+        template<class T, class F>
+        inline F discount(const T& u, size_t n, const T* t, const F* f, 
+            const F& _f = std::numeric_limits<F>::quiet_NaN()) noexcept
+        {
+            return exp(-unchecked::integral(u, n, t, f, _f));
+        }
+
+        template<class T, class F>
+        constexpr F spot(const T& u, size_t n, const T* t, const F* f, 
+            const F& _f = std::numeric_limits<F>::quiet_NaN()) noexcept
+        {
+            if (n == 0)
+                return u <= 0 ? _f : unchecked::integral(u, n, t, f, _f) / u;
+
+            return u <= t[0] ? f[0] : unchecked::integral(u, n, t, f, _f) / u;
+        }
+
+    } // unchecked
+
     // piecewise flat curve
     // return f[i] if t[i-1] < u <= t[i], _f if u > t[n-1]
     // assumes t[i] monotonically increasing
@@ -47,12 +111,7 @@ namespace fms::pwflat {
         if (u < 0 || !strictly_increasing(n, t))
             return std::numeric_limits<F>::quiet_NaN();
 
-        if (n == 0)
-            return _f;
-
-        auto ti = std::lower_bound(t, t + n, u);
-
-        return ti == t + n ? _f : f[ti - t];
+        return unchecked::value(u, n, t, f, _f);
     }
 
     // int_0^u f(t) dt
@@ -63,17 +122,7 @@ namespace fms::pwflat {
         if (u < 0 || !strictly_increasing(n, t))
             return std::numeric_limits<F>::quiet_NaN();
 
-        F I{ 0 };
-        T t_{ 0 };
-
-        size_t i;
-        for (i = 0; i < n && t[i] <= u; ++i) {
-            I += f[i] * (t[i] - t_);
-            t_ = t[i];
-        }
-        I += (n == 0 || u > t[n - 1] ? _f : f[i]) *(u - t_);
-
-        return I;
+        return unchecked::integral(u, n, t, f, _f);
     }
 
     // discount D(u) = exp(-int_0^u f(t) dt)
@@ -92,6 +141,58 @@ namespace fms::pwflat {
         return u <= t[0] ? f[0] : integral(u, n, t, f, _f) / u;
     }
 
+    // Call op(i, j, D) for each cash flow time u[i], where D = D(u[i]) and j is the number of
+    // curve times t[j] <= u[i]. If u is sorted the cash flow times and curve times are merged
+    // in a single pass so the cost is O(m + n) instead of O(m n).
+    // The integral is accumulated in the same order as integral() so results are identical.
+    template<class U, class T, class F, class Op>
+    inline void discount_sweep(size_t m, const U* u, size_t n, const T* t, const F* f, const F& _f, Op op)
+    {
+        if (!strictly_increasing(n, t)) {
+            for (size_t i = 0; i < m; ++i) {
+                op(i, n, std::numeric_limits<F>::quiet_NaN());
+            }
+
+            return;
+        }
+
+        if (!std::is_sorted(u, u + m)) {
+            for (size_t i = 0; i < m; ++i) {
+                size_t j = std::upper_bound(t, t + n, static_cast<T>(u[i])) - t;
+                op(i, j, pwflat::discount<T,F>(u[i], n, t, f, _f));
+            }
+
+            return;
+        }
+
+        F I{ 0 };  // int_0^t_ f(s) ds
+        T t_{ 0 }; // t[j-1]
+        size_t j = 0;
+        for (size_t i = 0; i < m; ++i) {
+            const T ui = u[i];
+
+            if (ui < 0) {
+                op(i, j, std::numeric_limits<F>::quiet_NaN());
+
+                continue;
+            }
+
+            for (; j < n && t[j] <= ui; ++j) {
+                I += f[j] * (t[j] - t_);
+                t_ = t[j];
+            }
+
+            F Ii = I;
+            if (j < n) {
+                Ii += f[j] * (ui - t_);
+            }
+            else if (n == 0 || ui > t_) {
+                Ii += _f * (ui - t_);
+            }
+
+            op(i, j, exp(-Ii));
+        }
+    }
 
     // present value of instrument having cash flow c[i] at time u[i]
     template<class U, class C, class T, class F>
@@ -100,9 +201,9 @@ namespace fms::pwflat {
     {
         F p{ 0 };
 
-        for (size_t i = 0; i < m; ++i) {
-            p += c[i] * pwflat::discount<T,F>(u[i], n, t, f, _f);
-        }
+        discount_sweep(m, u, n, t, f, _f, [&p, c](size_t i, size_t, const F& D) {
+            p += c[i] * D;
+        });
 
         return p;
     }
@@ -114,9 +215,9 @@ namespace fms::pwflat {
     {
         F d{ 0 };
 
-        for (size_t i = 0; i < m; ++i) {
-            d -= u[i] * c[i] * pwflat::discount(u[i], n, t, f, _f);
-        }
+        discount_sweep(m, u, n, t, f, _f, [&d, u, c](size_t i, size_t, const F& D) {
+            d -= u[i] * c[i] * D;
+        });
 
         return d;
     }
@@ -131,13 +232,38 @@ namespace fms::pwflat {
         // first cash flow past end of forward curve
         size_t i0 = (n == 0) ? 0 : std::lower_bound(u, u + m, t[n - 1]) - u;
         T t0 = (n == 0) ? 0 : t[n - 1];
-        for (size_t i = i0; i < m; ++i) {
-            d -= (u[i] - t0)*c[i] * pwflat::discount<T,F>(u[i], n, t, f, _f);
-        }
+        u += i0;
+        c += i0;
+        discount_sweep(m - i0, u, n, t, f, _f, [&d, t0, u, c](size_t i, size_t, const F& D) {
+            d -= (u[i] - t0)*c[i] * D;
+        });
 
         return d;
     }
 
+    // Derivative of present value wrt each forward of the curve.
+    // Adds dPV/df[j] to d[j] for j < n and dPV/d_f to d[n] so portfolios can be accumulated.
+    // A cash flow at u with t[j-1] <= u < t[j] contributes -c D(u) (t[k] - t[k-1]) to d[k]
+    // for k < j and -c D(u) (u - t[j-1]) to d[j], so suffix sums give all of them in O(m + n).
+    template<class U, class C, class T, class F>
+    inline void key_rate_duration(size_t m, const U* u, const C* c, size_t n, const T* t, const F* f, F* d,
+        const F& _f = std::numeric_limits<F>::quiet_NaN())
+    {
+        std::vector<F> A(n + 1, F(0)); // A[j] is sum of c D(u) for cash flows in segment j
+
+        discount_sweep(m, u, n, t, f, _f, [&A, d, u, c, t](size_t i, size_t j, const F& D) {
+            F cD = c[i] * D;
+            A[j] += cD;
+            d[j] -= cD * (u[i] - (j == 0 ? T(0) : t[j - 1]));
+        });
+
+        F S{ 0 }; // sum of A[k] for k > j
+        for (size_t j = n; j-- > 0; ) {
+            S += A[j + 1];
+            d[j] -= S * (t[j] - (j == 0 ? T(0) : t[j - 1]));
+        }
+    }
+
     // NVI curve interface.
     template<class T = double, class F = double>
     class curve {
@@ -172,6 +298,7 @@ namespace fms::pwflat {
         size_t   size() const { return _size(); }
         const T* time() const { return _time(); }
         const F* rate() const { return _rate(); }
+        const F& extrapolate() const { return _f; }
 
         F value(T u) const
         {
@@ -187,7 +314,7 @@ namespace fms::pwflat {
         }
         F spot(T u) const
         {
-            return spot<T,F>(u, size(), time(), rate(), _f);
+            return pwflat::spot<T,F>(u, size(), time(), rate(), _f);
         }
         F forward(T u) const
         {
@@ -203,6 +330,29 @@ namespace fms::pwflat {
         {
             return pwflat::duration<U,C,T,F>(i.size(), i.time(), i.cash(), size(), time(), rate(), _f);
         }
+        // derivative of present value wrt each forward and the extrapolated forward
+        template<class U, class C>
+        std::vector<F> key_rate_duration(const fixed_income::instrument<U,C>& i) const
+        {
+            std::vector<F> d(size() + 1, F(0));
+
+            pwflat::key_rate_duration<U,C,T,F>(i.size(), i.time(), i.cash(), size(), time(), rate(), d.data(), _f);
+
+            return d;
+        }
+        // sum of key rate durations over a range of instruments
+        template<class I>
+        std::vector<F> key_rate_duration(I b, I e) const
+        {
+            std::vector<F> d(size() + 1, F(0));
+
+            for (; b != e; ++b) {
+                const auto& i = *b;
+                pwflat::key_rate_duration(i.size(), i.time(), i.cash(), size(), time(), rate(), d.data(), _f);
+            }
+
+            return d;
+        }
     private:
         virtual size_t _size() const
         {
@@ -218,4 +368,49 @@ namespace fms::pwflat {
         }
     };
 
+    // Curve that is validated once when constructed.
+    // Evaluation does not check that times are strictly increasing.
+    template<class T = double, class F = double>
+    class valid_curve : public curve<T,F> {
+    public:
+        typedef curve<T,F> base;
+        using base::size;
+        using base::time;
+        using base::rate;
+        using base::extrapolate;
+
+        valid_curve(size_t n, T* t, F* f, F _f = std::numeric_limits<F>::quiet_NaN())
+            : base(n, t, f, _f)
+        {
+            ensure (n == 0 || (t != nullptr && f != nullptr));
+            ensure (n == 0 || t[0] >= 0);
+            ensure (strictly_increasing(n, t));
+            for (size_t i = 0; i < n; ++i) {
+                ensure (t[i] == t[i]); // not NaN
+                ensure (f[i] == f[i]);
+            }
+        }
+
+        F value(T u) const
+        {
+            return unchecked::value<T,F>(u, size(), time(), rate(), extrapolate());
+        }
+        F operator()(T u) const
+        {
+            return value(u);
+        }
+        F integral(T u) const
+        {
+            return unchecked::integral<T,F>(u, size(), time(), rate(), extrapolate());
+        }
+        F discount(T u) const
+        {
+            return unchecked::discount<T,F>(u, size(), time(), rate(), extrapolate());
+        }
+        F spot(T u) const
+        {
+            return unchecked::spot<T,F>(u, size(), time(), rate(), extrapolate());
+        }
+    };
+
 } // fms::pwflat
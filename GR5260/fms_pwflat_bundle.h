@@ -0,0 +1,129 @@
+// fms_pwflat_bundle.h - scenarios of piecewise flat curves having the same times
+#pragma once
+#include <vector>
+#include "fms_pwflat.h"
+#include "fms_simd.h"
+
+namespace fms::pwflat {
+
+    // K forward curves on common times t[0] < ... < t[n-1], e.g., simulated LMM curves or
+    // bumped copies of a curve. Forwards are stored structure of arrays: the K forwards for
+    // segment j are contiguous so loops over scenarios use the fms::simd kernels.
+    template<class T = double, class F = double>
+    class bundle {
+        size_t K;
+        std::vector<T> t;
+        std::vector<F> f;  // f[j*K + k] is scenario k forward on segment j
+        std::vector<F> _f; // _f[k] is scenario k extrapolation
+    public:
+        typedef T time_type;
+        typedef F rate_type;
+
+        bundle(size_t n, const T* t, size_t K, F _f = std::numeric_limits<F>::quiet_NaN())
+            : K(K), t(t, t + n), f(n*K), _f(K, _f)
+        {
+            ensure (strictly_increasing(n, t));
+        }
+
+        size_t size() const { return t.size(); }
+        size_t scenarios() const { return K; }
+        const T* time() const { return t.data(); }
+
+        // forwards on segment j for all scenarios
+        const F* rate(size_t j) const { return f.data() + j*K; }
+        F* rate(size_t j) { return f.data() + j*K; }
+        const F* extrapolate() const { return _f.data(); }
+
+        // forward on segment j for scenario k
+        F& operator()(size_t j, size_t k)
+        {
+            return f[j*K + k];
+        }
+        const F& operator()(size_t j, size_t k) const
+        {
+            return f[j*K + k];
+        }
+
+        // set forwards of scenario k
+        bundle& assign(size_t k, const F* f_, F _f_ = std::numeric_limits<F>::quiet_NaN())
+        {
+            for (size_t j = 0; j < size(); ++j) {
+                f[j*K + k] = f_[j];
+            }
+            _f[k] = _f_;
+
+            return *this;
+        }
+        // set scenario k from a curve having the same times
+        bundle& assign(size_t k, const curve<T,F>& c)
+        {
+            ensure (c.size() == size() && std::equal(t.begin(), t.end(), c.time()));
+
+            return assign(k, c.rate(), c.extrapolate());
+        }
+
+        // D[k*m + i] = D_k(u[i]) for sorted times u
+        template<class U>
+        void discount(size_t m, const U* u, F* D) const
+        {
+            sweep(m, u, [this, m, D](size_t i, const F* Di) {
+                for (size_t k = 0; k < K; ++k) {
+                    D[k*m + i] = Di[k];
+                }
+            });
+        }
+
+        // pv[k] = sum_i c[i] D_k(u[i]) for sorted times u
+        template<class U, class C>
+        void present_value(size_t m, const U* u, const C* c, F* pv) const
+        {
+            std::fill(pv, pv + K, F(0));
+            sweep(m, u, [this, c, pv](size_t i, const F* Di) {
+                simd::axpy(K, F(c[i]), Di, pv);
+            });
+        }
+        template<class U, class C>
+        void present_value(const fixed_income::instrument<U,C>& i, F* pv) const
+        {
+            present_value(i.size(), i.time(), i.cash(), pv);
+        }
+
+    private:
+        // Call op(i, D) where D[k] = D_k(u[i]). Same merge as pwflat::discount_sweep
+        // with the integrals for all scenarios updated together.
+        template<class U, class Op>
+        void sweep(size_t m, const U* u, Op op) const
+        {
+            ensure (std::is_sorted(u, u + m));
+            ensure (m == 0 || u[0] >= 0);
+
+            size_t n = size();
+            std::vector<F> I(K), E(K);
+            T t_{ 0 };
+            size_t j = 0;
+            for (size_t i = 0; i < m; ++i) {
+                const T ui = u[i];
+
+                for (; j < n && t[j] <= ui; ++j) {
+                    simd::axpy(K, F(t[j] - t_), rate(j), I.data());
+                    t_ = t[j];
+                }
+
+                E = I;
+                if (j < n) {
+                    simd::axpy(K, F(ui - t_), rate(j), E.data());
+                }
+                else if (n == 0 || ui > t_) {
+                    simd::axpy(K, F(ui - t_), _f.data(), E.data());
+                }
+                for (auto& e : E) {
+                    e = -e;
+                }
+                simd::exp(K, E.data(), E.data());
+
+                op(i, E.data());
+            }
+        }
+    };
+
+} // fms::pwflat
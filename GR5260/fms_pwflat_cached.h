@@ -0,0 +1,163 @@
+// fms_pwflat_cached.h - piecewise flat curve with cached integrals
+#pragma once
+#include <vector>
+#include "fms_pwflat.h"
+#include "../xll12/xll/ensure.h"
+
+namespace fms::pwflat {
+
+    // Owns a copy of the curve and caches I[i] = int_0^t[i] f(s) ds and D[i] = exp(-I[i]).
+    // Point queries take one binary search and at most one exp.
+    // If buckets > 0 a uniform grid on [0, t[n-1]] is used to find the segment in O(1)
+    // when times are roughly evenly spaced, e.g., large intraday curves.
+    template<class T = double, class F = double>
+    class cached_curve {
+        std::vector<T> t;
+        std::vector<F> f;
+        std::vector<F> I; // int_0^t[i] f(s) ds
+        std::vector<F> D; // exp(-I[i])
+        F _f;
+        T h; // grid spacing
+        std::vector<size_t> grid; // grid[k] is index of first t[i] >= k*h
+    public:
+        typedef T time_type;
+        typedef F rate_type;
+
+        cached_curve(size_t n = 0, const T* t_ = nullptr, const F* f_ = nullptr,
+            F _f = std::numeric_limits<F>::quiet_NaN(), size_t buckets = 0)
+            : t(t_, t_ + n), f(f_, f_ + n), I(n), D(n), _f(_f), h(0)
+        {
+            ensure (strictly_increasing(n, t_));
+
+            // same order of summation as pwflat::integral
+            F I_{ 0 };
+            T t0{ 0 };
+            for (size_t i = 0; i < n; ++i) {
+                I_ += f[i] * (t[i] - t0);
+                t0 = t[i];
+                I[i] = I_;
+                D[i] = exp(-I_);
+            }
+
+            // no grid if the spacing is 0, e.g., t = {0}
+            if (n > 0 && buckets > 0 && t[n - 1]/buckets > 0) {
+                h = t[n - 1]/buckets;
+                grid.resize(buckets + 1);
+                for (size_t k = 0; k <= buckets; ++k) {
+                    grid[k] = std::lower_bound(t.begin(), t.end(), k*h) - t.begin();
+                }
+            }
+        }
+        // keeps the extrapolation of c
+        cached_curve(const curve<T,F>& c)
+            : cached_curve(c.size(), c.time(), c.rate(), c.extrapolate())
+        { }
+        cached_curve(const curve<T,F>& c, F _f, size_t buckets = 0)
+            : cached_curve(c.size(), c.time(), c.rate(), _f, buckets)
+        { }
+
+        size_t   size() const { return t.size(); }
+        const T* time() const { return t.data(); }
+        const F* rate() const { return f.data(); }
+        F extrapolate() const { return _f; }
+
+        // index of first t[i] >= u, size() if none
+        size_t index(T u) const
+        {
+            size_t n = size();
+
+            // u/h is only converted for u in [0, t[n-1]], not NaN
+            if (grid.size() == 0 || !(u >= 0 && u <= t[n - 1])) {
+                return std::lower_bound(t.begin(), t.end(), u) - t.begin();
+            }
+
+            size_t k = static_cast<size_t>(u/h);
+            size_t i = grid[k < grid.size() ? k : grid.size() - 1];
+            while (i > 0 && t[i - 1] >= u) {
+                --i;
+            }
+            while (t[i] < u) {
+                ++i;
+            }
+
+            return i;
+        }
+
+        F value(T u) const
+        {
+            if (!(u >= 0)) // negative or NaN
+                return std::numeric_limits<F>::quiet_NaN();
+
+            size_t i = index(u);
+
+            return i == size() ? _f : f[i];
+        }
+        F operator()(T u) const
+        {
+            return value(u);
+        }
+
+        // int_0^u f(t) dt
+        F integral(T u) const
+        {
+            if (!(u >= 0)) // negative or NaN
+                return std::numeric_limits<F>::quiet_NaN();
+
+            size_t i = index(u);
+            F I_ = i == 0 ? F(0) : I[i - 1];
+            T t_ = i == 0 ? T(0) : t[i - 1];
+
+            return I_ + (i == size() ? _f : f[i]) * (u - t_);
+        }
+
+        // D(u) = D(t[i-1]) exp(-f[i] (u - t[i-1]))
+        F discount(T u) const
+        {
+            if (!(u >= 0)) // negative or NaN
+                return std::numeric_limits<F>::quiet_NaN();
+
+            size_t i = index(u);
+            if (i < size() && t[i] == u) {
+                return D[i];
+            }
+
+            F D_ = i == 0 ? F(1) : D[i - 1];
+            T t_ = i == 0 ? T(0) : t[i - 1];
+
+            return D_ * exp(-(i == size() ? _f : f[i]) * (u - t_));
+        }
+
+        // r(u) = (int_0^u f(t) dt)/u
+        F spot(T u) const
+        {
+            if (size() == 0)
+                return u <= 0 ? _f : integral(u) / u;
+
+            return u <= t[0] ? f[0] : integral(u) / u;
+        }
+
+        template<class U, class C>
+        F present_value(const fixed_income::instrument<U,C>& i) const
+        {
+            F p{ 0 };
+
+            for (size_t j = 0; j < i.size(); ++j) {
+                p += i.cash()[j] * discount(i.time()[j]);
+            }
+
+            return p;
+        }
+        template<class U, class C>
+        F duration(const fixed_income::instrument<U,C>& i) const
+        {
+            F d{ 0 };
+
+            for (size_t j = 0; j < i.size(); ++j) {
+                d -= i.time()[j] * i.cash()[j] * discount(i.time()[j]);
+            }
+
+            return d;
+        }
+    };
+
+} // fms::pwflat
@@ -0,0 +1,119 @@
+// fms_pwflat_parallel.h - value portfolios on multiple threads
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "fms_pwflat_portfolio.h"
+#include "../xll12/xll/ensure.h"
+
+namespace fms::pwflat::parallel {
+
+    // Call op(k0, k1, c) for chunks [k0, k1) = [c*chunk, min((c + 1)*chunk, size)) using threads.
+    // Chunks are handed out by an atomic counter so faster threads take more of them.
+    // If threads is 0 the hardware concurrency is used. op must not throw.
+    template<class Op>
+    inline void for_each_chunk(size_t size, size_t chunk, size_t threads, Op op)
+    {
+        ensure (chunk > 0);
+
+        size_t chunks = (size + chunk - 1)/chunk;
+        if (threads == 0) {
+            threads = std::thread::hardware_concurrency();
+        }
+        threads = std::max<size_t>(1, std::min(threads, chunks));
+
+        std::atomic<size_t> next{ 0 };
+        auto work = [&next, chunks, chunk, size, &op]() {
+            for (size_t c = next++; c < chunks; c = next++) {
+                size_t k0 = c*chunk;
+                op(k0, std::min(k0 + chunk, size), c);
+            }
+        };
+
+        std::vector<std::thread> pool;
+        pool.reserve(threads - 1);
+        for (size_t i = 1; i < threads; ++i) {
+            pool.emplace_back(work);
+        }
+        work();
+        for (auto& th : pool) {
+            th.join();
+        }
+    }
+
+    // Fill x[k] for 0 <= k < size by calling op(k0, k1) on chunks and return the sum of x.
+    // Each chunk is summed in index order and the chunk sums are added in chunk order,
+    // so the total only depends on chunk and not on the number of threads.
+    template<class F, class Op>
+    inline F reduce(size_t size, F* x, size_t chunk, size_t threads, Op op)
+    {
+        ensure (chunk > 0);
+
+        std::vector<F> s((size + chunk - 1)/chunk, F(0));
+        for_each_chunk(size, chunk, threads, [x, &s, &op](size_t k0, size_t k1, size_t c) {
+            op(k0, k1);
+            F s_{ 0 };
+            for (size_t k = k0; k < k1; ++k) {
+                s_ += x[k];
+            }
+            s[c] = s_;
+        });
+
+        F S{ 0 };
+        for (const auto& s_ : s) {
+            S += s_;
+        }
+
+        return S;
+    }
+
+    // Present value pv[k] of every instrument in a portfolio. Returns the total present value.
+    template<class U, class C, class T, class F>
+    inline F present_value(const fixed_income::portfolio<U,C>& P, size_t n, const T* t, const F* f, F* pv,
+        const F& _f = std::numeric_limits<F>::quiet_NaN(), size_t threads = 0, size_t chunk = 1024)
+    {
+        if (!strictly_increasing(n, t)) {
+            std::fill(pv, pv + P.size(), std::numeric_limits<F>::quiet_NaN());
+
+            return std::numeric_limits<F>::quiet_NaN();
+        }
+
+        auto I = cumulative_integral(n, t, f);
+
+        return reduce(P.size(), pv, chunk, threads, [&](size_t k0, size_t k1) {
+            pwflat::present_value(P, k0, k1, n, t, f, I.data(), pv, _f);
+        });
+    }
+    template<class U, class C, class T, class F>
+    inline F present_value(const fixed_income::portfolio<U,C>& P, const curve<T,F>& f, F* pv,
+        size_t threads = 0, size_t chunk = 1024)
+    {
+        return present_value(P, f.size(), f.time(), f.rate(), pv, f.extrapolate(), threads, chunk);
+    }
+
+    // Duration dur[k] of every instrument in a portfolio. Returns the total duration.
+    template<class U, class C, class T, class F>
+    inline F duration(const fixed_income::portfolio<U,C>& P, size_t n, const T* t, const F* f, F* dur,
+        const F& _f = std::numeric_limits<F>::quiet_NaN(), size_t threads = 0, size_t chunk = 1024)
+    {
+        if (!strictly_increasing(n, t)) {
+            std::fill(dur, dur + P.size(), std::numeric_limits<F>::quiet_NaN());
+
+            return std::numeric_limits<F>::quiet_NaN();
+        }
+
+        auto I = cumulative_integral(n, t, f);
+
+        return reduce(P.size(), dur, chunk, threads, [&](size_t k0, size_t k1) {
+            pwflat::duration(P, k0, k1, n, t, f, I.data(), dur, _f);
+        });
+    }
+    template<class U, class C, class T, class F>
+    inline F duration(const fixed_income::portfolio<U,C>& P, const curve<T,F>& f, F* dur,
+        size_t threads = 0, size_t chunk = 1024)
+    {
+        return duration(P, f.size(), f.time(), f.rate(), dur, f.extrapolate(), threads, chunk);
+    }
+
+} // fms::pwflat::parallel
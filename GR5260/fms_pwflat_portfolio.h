@@ -0,0 +1,139 @@
+// fms_pwflat_portfolio.h - value portfolios using a piecewise flat curve
+#pragma once
+#include <vector>
+#include "fms_fixed_income_portfolio.h"
+#include "fms_pwflat.h"
+
+namespace fms::pwflat {
+
+    // I[j] = int_0^t[j] f(s) ds accumulated in the same order as integral()
+    template<class T, class F>
+    inline std::vector<F> cumulative_integral(size_t n, const T* t, const F* f)
+    {
+        std::vector<F> I(n);
+        F I_{ 0 };
+        T t_{ 0 };
+
+        for (size_t j = 0; j < n; ++j) {
+            I_ += f[j] * (t[j] - t_);
+            t_ = t[j];
+            I[j] = I_;
+        }
+
+        return I;
+    }
+
+    // Call op(k, l, D) with D = D(u[l]) for cash flows l of instruments k0 <= k < k1 given
+    // cumulative integrals I of the curve. Streams through the contiguous cash flows with one
+    // exp per cash flow. Discounts are identical to discount_sweep for each instrument.
+    template<class U, class C, class T, class F, class Op>
+    inline void portfolio_sweep(const fixed_income::portfolio<U,C>& P, size_t k0, size_t k1,
+        size_t n, const T* t, const F* f, const F* I, const F& _f, Op op)
+    {
+        const U* u = P.time();
+        const size_t* off = P.offset();
+
+        for (size_t k = k0; k < k1; ++k) {
+            size_t j = 0;
+
+            for (size_t l = off[k]; l < off[k + 1]; ++l) {
+                const T ul = u[l];
+
+                if (ul < 0) {
+                    op(k, l, std::numeric_limits<F>::quiet_NaN());
+
+                    continue;
+                }
+
+                // cash flow times are usually increasing so walk forward from the last one
+                if (l > off[k] && ul >= u[l - 1]) {
+                    for (; j < n && t[j] <= ul; ++j)
+                        ;
+                }
+                else {
+                    j = std::upper_bound(t, t + n, ul) - t;
+                }
+                F Il = j == 0 ? F(0) : I[j - 1];
+                T t_ = j == 0 ? T(0) : t[j - 1];
+                if (j < n) {
+                    Il += f[j] * (ul - t_);
+                }
+                else if (n == 0 || ul > t_) {
+                    Il += _f * (ul - t_);
+                }
+
+                op(k, l, exp(-Il));
+            }
+        }
+    }
+
+    // Present value pv[k] of instruments k0 <= k < k1.
+    // Results are identical to present_value for each instrument.
+    template<class U, class C, class T, class F>
+    inline void present_value(const fixed_income::portfolio<U,C>& P, size_t k0, size_t k1,
+        size_t n, const T* t, const F* f, const F* I, F* pv, const F& _f)
+    {
+        const C* c = P.cash();
+
+        std::fill(pv + k0, pv + k1, F(0));
+        portfolio_sweep(P, k0, k1, n, t, f, I, _f, [c, pv](size_t k, size_t l, const F& D) {
+            pv[k] += c[l] * D;
+        });
+    }
+
+    // Duration dur[k] of instruments k0 <= k < k1.
+    // Results are identical to duration for each instrument.
+    template<class U, class C, class T, class F>
+    inline void duration(const fixed_income::portfolio<U,C>& P, size_t k0, size_t k1,
+        size_t n, const T* t, const F* f, const F* I, F* dur, const F& _f)
+    {
+        const U* u = P.time();
+        const C* c = P.cash();
+
+        std::fill(dur + k0, dur + k1, F(0));
+        portfolio_sweep(P, k0, k1, n, t, f, I, _f, [u, c, dur](size_t k, size_t l, const F& D) {
+            dur[k] -= u[l] * c[l] * D;
+        });
+    }
+
+    // Present value pv[k] of every instrument in a portfolio.
+    template<class U, class C, class T, class F>
+    inline void present_value(const fixed_income::portfolio<U,C>& P, size_t n, const T* t, const F* f, F* pv,
+        const F& _f = std::numeric_limits<F>::quiet_NaN())
+    {
+        if (!strictly_increasing(n, t)) {
+            std::fill(pv, pv + P.size(), std::numeric_limits<F>::quiet_NaN());
+
+            return;
+        }
+
+        auto I = cumulative_integral(n, t, f);
+        present_value(P, 0, P.size(), n, t, f, I.data(), pv, _f);
+    }
+    template<class U, class C, class T, class F>
+    inline void present_value(const fixed_income::portfolio<U,C>& P, const curve<T,F>& f, F* pv)
+    {
+        present_value(P, f.size(), f.time(), f.rate(), pv, f.extrapolate());
+    }
+
+    // Duration dur[k] of every instrument in a portfolio.
+    template<class U, class C, class T, class F>
+    inline void duration(const fixed_income::portfolio<U,C>& P, size_t n, const T* t, const F* f, F* dur,
+        const F& _f = std::numeric_limits<F>::quiet_NaN())
+    {
+        if (!strictly_increasing(n, t)) {
+            std::fill(dur, dur + P.size(), std::numeric_limits<F>::quiet_NaN());
+
+            return;
+        }
+
+        auto I = cumulative_integral(n, t, f);
+        duration(P, 0, P.size(), n, t, f, I.data(), dur, _f);
+    }
+    template<class U, class C, class T, class F>
+    inline void duration(const fixed_income::portfolio<U,C>& P, const curve<T,F>& f, F* dur)
+    {
+        duration(P, f.size(), f.time(), f.rate(), dur, f.extrapolate());
+    }
+
+} // fms::pwflat
@@ -0,0 +1,84 @@
+// fms_pwflat_static.h - piecewise flat curve with inline fixed capacity storage
+#pragma once
+#include <array>
+#include "fms_pwflat.h"
+
+namespace fms::pwflat {
+
+    // Curve holding at most N points in std::array storage with no virtual functions.
+    // Curves known at compile time, e.g., test fixtures or shock templates, can be constexpr.
+    // Use size(), time(), rate(), and extrapolate() with the pwflat free functions.
+    template<size_t N, class T = double, class F = double>
+    class static_curve {
+        size_t n;
+        std::array<T,N> t;
+        std::array<F,N> f;
+        F _f;
+    public:
+        typedef T time_type;
+        typedef F rate_type;
+
+        // constant curve
+        constexpr static_curve(F _f = std::numeric_limits<F>::quiet_NaN())
+            : n(0), t{}, f{}, _f(_f)
+        { }
+        constexpr static_curve(const T(&t_)[N], const F(&f_)[N], F _f = std::numeric_limits<F>::quiet_NaN())
+            : n(0), t{}, f{}, _f(_f)
+        {
+            for (size_t i = 0; i < N; ++i) {
+                push_back(t_[i], f_[i]);
+            }
+        }
+
+        // add point past the end of the curve
+        constexpr static_curve& push_back(T t_, F f_)
+        {
+            ensure (n < N);
+            ensure (n == 0 ? t_ >= 0 : t_ > t[n - 1]);
+
+            t[n] = t_;
+            f[n] = f_;
+            ++n;
+
+            return *this;
+        }
+
+        static constexpr size_t capacity() { return N; }
+        constexpr size_t size() const { return n; }
+        constexpr const T* time() const { return t.data(); }
+        constexpr const F* rate() const { return f.data(); }
+        constexpr const F& extrapolate() const { return _f; }
+
+        constexpr F value(T u) const
+        {
+            return unchecked::value<T,F>(u, n, t.data(), f.data(), _f);
+        }
+        constexpr F operator()(T u) const
+        {
+            return value(u);
+        }
+        constexpr F integral(T u) const
+        {
+            return unchecked::integral<T,F>(u, n, t.data(), f.data(), _f);
+        }
+        constexpr F spot(T u) const
+        {
+            return unchecked::spot<T,F>(u, n, t.data(), f.data(), _f);
+        }
+        F discount(T u) const
+        {
+            return unchecked::discount<T,F>(u, n, t.data(), f.data(), _f);
+        }
+        template<class U, class C>
+        F present_value(const fixed_income::instrument<U,C>& i) const
+        {
+            return pwflat::present_value<U,C,T,F>(i.size(), i.time(), i.cash(), n, t.data(), f.data(), _f);
+        }
+        template<class U, class C>
+        F duration(const fixed_income::instrument<U,C>& i) const
+        {
+            return pwflat::duration<U,C,T,F>(i.size(), i.time(), i.cash(), n, t.data(), f.data(), _f);
+        }
+    };
+
+} // fms::pwflat
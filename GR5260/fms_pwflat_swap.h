@@ -0,0 +1,107 @@
+// fms_pwflat_swap.h - value swaps using the annuity of their schedule
+// PV = -D(t_0) + sum_{j>0} r delta_j D(t_j) + D(t_n) = r A - (D(t_0) - D(t_n))
+#pragma once
+#include <algorithm>
+#include <unordered_map>
+#include "fms_fixed_income_interest_rate_swap.h"
+#include "fms_pwflat.h"
+#include "../xll12/xll/ensure.h"
+
+namespace fms::pwflat {
+
+    // annuity A = sum_{j>0} delta_j D(t_j) and floating leg D(t_0) - D(t_n)
+    template<class F = double>
+    struct swap_legs {
+        F annuity;
+        F floating;
+    };
+
+    template<class U, class T, class F>
+    inline swap_legs<F> legs(const fixed_income::swap_schedule<U>& s, size_t n, const T* t, const F* f,
+        const F& _f = std::numeric_limits<F>::quiet_NaN())
+    {
+        swap_legs<F> L{ F(0), F(0) };
+        const U* dt = s.accrual();
+        size_t m = s.size();
+
+        discount_sweep(m, s.time(), n, t, f, _f, [&L, dt, m](size_t i, size_t, const F& D) {
+            if (i == 0) {
+                L.floating += D;
+            }
+            else {
+                L.annuity += dt[i] * D;
+            }
+            if (i + 1 == m) {
+                L.floating -= D;
+            }
+        });
+
+        return L;
+    }
+    template<class U, class T, class F>
+    inline swap_legs<F> legs(const fixed_income::swap_schedule<U>& s, const curve<T,F>& f)
+    {
+        return legs(s, f.size(), f.time(), f.rate(), f.extrapolate());
+    }
+
+    // Present value pv[k] of swaps s[k]. Legs are computed once per distinct schedule,
+    // so swaps sharing schedules from a swap_schedule_cache take one sweep per tenor.
+    template<class U, class C, class T, class F>
+    inline void present_value(size_t m, const fixed_income::interest_rate_swap<U,C>* s,
+        size_t n, const T* t, const F* f, F* pv, const F& _f = std::numeric_limits<F>::quiet_NaN())
+    {
+        std::unordered_map<const fixed_income::swap_schedule<U>*, swap_legs<F>> L;
+
+        for (size_t k = 0; k < m; ++k) {
+            const auto* sk = s[k].schedule().get();
+            auto i = L.find(sk);
+            if (i == L.end()) {
+                i = L.emplace(sk, legs(*sk, n, t, f, _f)).first;
+            }
+
+            pv[k] = s[k].coupon() * i->second.annuity - i->second.floating;
+        }
+    }
+    template<class U, class C, class T, class F>
+    inline void present_value(size_t m, const fixed_income::interest_rate_swap<U,C>* s, const curve<T,F>& f, F* pv)
+    {
+        present_value(m, s, f.size(), f.time(), f.rate(), pv, f.extrapolate());
+    }
+
+    // Par coupons r[k] of swaps with sorted tenors u[k] and frequency q.
+    // One sweep over the schedule of the longest tenor accumulates the annuities
+    // A_j = sum_{0 < i <= j} delta_i D(t_i) so r[k] = (D(t_0) - D(t_j))/A_j where j is the number of periods of u[k].
+    template<class U, class T, class F>
+    inline void par_coupons(size_t N, const U* u, fixed_income::frequency q, size_t n, const T* t, const F* f, F* r,
+        const F& _f = std::numeric_limits<F>::quiet_NaN())
+    {
+        ensure (std::is_sorted(u, u + N));
+
+        if (N == 0) {
+            return;
+        }
+
+        fixed_income::swap_schedule<U> s(u[N - 1], q);
+        const U* dt = s.accrual();
+        F A{ 0 }, D0{ 1 };
+        size_t k = 0;
+
+        discount_sweep(s.size(), s.time(), n, t, f, _f, [&](size_t i, size_t, const F& D) {
+            if (i == 0) {
+                D0 = D;
+            }
+            else {
+                A += dt[i] * D;
+            }
+            for (; k < N && fixed_income::swap_schedule<U>::periods(u[k], q) == i; ++k) {
+                r[k] = (D0 - D)/A;
+            }
+        });
+    }
+    template<class U, class T, class F>
+    inline void par_coupons(size_t N, const U* u, fixed_income::frequency q, const curve<T,F>& f, F* r)
+    {
+        par_coupons(N, u, q, f.size(), f.time(), f.rate(), r, f.extrapolate());
+    }
+
+} // fms::pwflat
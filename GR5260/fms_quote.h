@@ -0,0 +1,374 @@
+// fms_quote.h - stream market quotes into a curve builder
+// Line protocol, one quote per line:
+// D u r     cash deposit maturing at u with rate r
+// F u v r   forward rate agreement from u to v with rate r
+// S u q r   interest rate swap with tenor u, frequency q = 1, 2, 4, or 12, and par coupon r
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <istream>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "fms_bootstrap.h"
+#include "fms_fixed_income.h"
+#include "fms_spsc.h"
+#include "../xll12/xll/ensure.h"
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace fms::quote {
+
+    // nanoseconds since an arbitrary epoch
+    inline int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    struct quote {
+        char type; // 'D', 'F', or 'S'
+        double u;
+        double v;  // FRA end or swap frequency
+        double r;
+        int64_t received;
+
+        // identifies the instrument
+        std::tuple<char, double, double> key() const
+        {
+            return std::make_tuple(type, u, type == 'D' ? 0. : v);
+        }
+        double maturity() const
+        {
+            return type == 'F' ? v : u;
+        }
+    };
+
+    // swap frequency is one of the fixed_income::frequency enumerators
+    inline bool valid_frequency(double v)
+    {
+        return v == 1 || v == 2 || v == 4 || v == 12;
+    }
+
+    // false if line is not a valid quote
+    inline bool parse(const char* line, quote& q)
+    {
+        char* e;
+
+        while (*line == ' ') {
+            ++line;
+        }
+        q.type = *line;
+        if (q.type != 'D' && q.type != 'F' && q.type != 'S') {
+            return false;
+        }
+        ++line;
+
+        q.u = strtod(line, &e);
+        if (e == line) {
+            return false;
+        }
+        line = e;
+        q.v = 0;
+        if (q.type != 'D') {
+            q.v = strtod(line, &e);
+            if (e == line) {
+                return false;
+            }
+            line = e;
+        }
+        q.r = strtod(line, &e);
+        if (e == line) {
+            return false;
+        }
+
+        if (q.type == 'S') {
+            return valid_frequency(q.v);
+        }
+
+        return q.type != 'F' || q.v > q.u;
+    }
+
+    // instrument having the quote as a par rate
+    template<class U = double, class C = double>
+    inline std::unique_ptr<fixed_income::instrument<U,C>> instrument(const quote& q)
+    {
+        using namespace fixed_income;
+
+        if (q.type == 'D')
+            return std::make_unique<cash_deposit<U,C>>(q.u, q.r);
+        if (q.type == 'F')
+            return std::make_unique<forward_rate_agreement<U,C>>(q.u, q.v, q.r);
+
+        ensure (valid_frequency(q.v));
+
+        return std::make_unique<interest_rate_swap<U,C>>(q.u, q.r, static_cast<frequency>(static_cast<int>(q.v)));
+    }
+
+    // price of instrument(q)
+    template<class F = double>
+    inline F price(const quote& q)
+    {
+        return q.type == 'D' ? F(1) : F(0);
+    }
+
+    // Quotes are posted by one thread, e.g., reading a file or socket, and consumed by another
+    // that rebuilds the curve. Bursts of quotes that arrive while the curve is being built
+    // are coalesced: only the last quote for each instrument is used and the curve is rebuilt
+    // once from the shortest maturity changed.
+    // Latency percentiles are over the last L quotes so memory does not grow with the feed.
+    template<class T = double, class F = double, size_t N = 4096, size_t L = 65536>
+    class pipeline {
+        spsc<quote, N> ring;
+        std::atomic<bool> closed;
+        std::map<std::tuple<char, double, double>, size_t> index;
+        std::vector<std::unique_ptr<fixed_income::instrument<T,F>>> i;
+        pwflat::curve_builder<T,F,T,F> cb;
+        std::function<void(const pwflat::curve_builder<T,F,T,F>&)> publish;
+        std::vector<int64_t> latency; // nanoseconds from receipt to publish, ring of size L
+        size_t latency_; // next entry to overwrite
+        size_t quotes, builds, ignored, dropped;
+    public:
+        // Instruments of the curve are given by initial quotes with increasing maturities.
+        pipeline(size_t n, const quote* q,
+            const std::function<void(const pwflat::curve_builder<T,F,T,F>&)>& publish = nullptr)
+            : closed(false), publish(publish), latency_(0), quotes(0), builds(0), ignored(0), dropped(0)
+        {
+            static_assert(L > 0);
+
+            for (size_t k = 0; k < n; ++k) {
+                ensure (k == 0 || q[k].maturity() > q[k - 1].maturity());
+                ensure (index.emplace(q[k].key(), k).second);
+
+                i.push_back(instrument<T,F>(q[k]));
+                cb.add(*i.back(), price<F>(q[k]));
+            }
+        }
+        pipeline(const pipeline&) = delete;
+        pipeline& operator=(const pipeline&) = delete;
+
+        // Producer: parse line and queue it. Waits if the queue is full.
+        // Returns false if the line is not a quote.
+        bool post(const char* line)
+        {
+            quote q;
+            if (!parse(line, q)) {
+                return false;
+            }
+            q.received = now();
+            while (!ring.push(q)) {
+                std::this_thread::yield();
+            }
+
+            return true;
+        }
+        // Producer: post all lines of a stream then close.
+        void feed(std::istream& is)
+        {
+            std::string line;
+            while (std::getline(is, line)) {
+                post(line.c_str());
+            }
+            close();
+        }
+#ifndef _WIN32
+        // Producer: post all lines read from a file descriptor, e.g., a pipe or
+        // connected UNIX domain socket, until end of file then close.
+        void feed(int fd)
+        {
+            std::string buf;
+            char b[4096];
+            ssize_t n;
+
+            while ((n = ::read(fd, b, sizeof(b))) > 0) {
+                buf.append(b, static_cast<size_t>(n));
+                size_t i0 = 0, i1;
+                while ((i1 = buf.find('\n', i0)) != std::string::npos) {
+                    buf[i1] = 0;
+                    post(buf.c_str() + i0);
+                    i0 = i1 + 1;
+                }
+                buf.erase(0, i0);
+            }
+            if (buf.size() > 0) {
+                post(buf.c_str());
+            }
+            close();
+        }
+#endif
+        // Producer: no more quotes.
+        void close()
+        {
+            closed.store(true, std::memory_order_release);
+        }
+
+        // Consumer: apply queued quotes and rebuild the curve.
+        // Returns number of quotes taken from the queue.
+        size_t poll()
+        {
+            std::vector<size_t> k;
+            std::vector<std::unique_ptr<fixed_income::instrument<T,F>>> i_;
+            std::vector<F> p;
+            std::vector<int64_t> received;
+            quote q;
+
+            // at most N so a steady stream does not starve the rebuild
+            for (size_t n = 0; n < N && ring.pop(q); ++n) {
+                received.push_back(q.received);
+                auto j = index.find(q.key());
+                if (j == index.end()) {
+                    ++ignored;
+
+                    continue;
+                }
+                auto l = std::find(k.begin(), k.end(), j->second);
+                if (l == k.end()) {
+                    k.push_back(j->second);
+                    i_.push_back(instrument<T,F>(q));
+                    p.push_back(price<F>(q));
+                }
+                else {
+                    i_[l - k.begin()] = instrument<T,F>(q);
+                    p[l - k.begin()] = price<F>(q);
+                }
+            }
+            if (received.size() == 0) {
+                return 0;
+            }
+            quotes += received.size();
+
+            if (k.size() > 0) {
+                // the builder holds pointers so i owns the new instruments before the update
+                // and i_ keeps the old ones in case the curve can not be built
+                std::vector<const fixed_income::instrument<T,F>*> pi(k.size());
+                std::vector<F> p_(k.size());
+                for (size_t l = 0; l < k.size(); ++l) {
+                    p_[l] = cb.price(k[l]);
+                    std::swap(i[k[l]], i_[l]);
+                    pi[l] = i[k[l]].get();
+                }
+                bool built = true;
+                try {
+                    cb.update(k.size(), k.data(), pi.data(), p.data());
+                }
+                catch (const std::exception&) {
+                    // drop the burst and rebuild the last good curve
+                    built = false;
+                    for (size_t l = 0; l < k.size(); ++l) {
+                        std::swap(i[k[l]], i_[l]);
+                        pi[l] = i[k[l]].get();
+                    }
+                    cb.update(k.size(), k.data(), pi.data(), p_.data());
+                    dropped += k.size();
+                }
+                if (built) {
+                    ++builds;
+                    if (publish) {
+                        publish(cb);
+                    }
+                }
+            }
+
+            int64_t t = now();
+            for (auto r : received) {
+                if (latency.size() < L) {
+                    latency.push_back(t - r);
+                }
+                else {
+                    latency[latency_] = t - r;
+                    latency_ = (latency_ + 1) % L;
+                }
+            }
+
+            return received.size();
+        }
+        // Consumer: poll until closed and the queue is empty.
+        void run()
+        {
+            while (!closed.load(std::memory_order_acquire) || !ring.empty()) {
+                if (poll() == 0) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        const pwflat::curve_builder<T,F,T,F>& curve() const { return cb; }
+        size_t size() const { return quotes; }
+        size_t rebuilds() const { return builds; }
+        size_t unknown() const { return ignored; }
+        size_t rejected() const { return dropped; }
+
+        // p-th percentile, 0 <= p <= 1, of the last L latencies in seconds
+        double percentile(double p) const
+        {
+            if (latency.size() == 0) {
+                return std::numeric_limits<double>::quiet_NaN();
+            }
+
+            std::vector<int64_t> l(latency);
+            auto n = static_cast<size_t>(p*(l.size() - 1));
+            std::nth_element(l.begin(), l.begin() + n, l.end());
+
+            return l[n]*1e-9;
+        }
+    };
+
+    // Write one line per quote.
+    inline std::ostream& operator<<(std::ostream& os, const quote& q)
+    {
+        os << q.type << ' ' << q.u << ' ';
+        if (q.type != 'D') {
+            os << q.v << ' ';
+        }
+
+        return os << q.r;
+    }
+
+    // Write m ticks moving the rate of a random quote by a normal with standard deviation s.
+    // A recorded feed for replay.
+    inline void simulate(std::ostream& os, size_t n, const quote* q, size_t m, double s = 0.0001, unsigned seed = 0)
+    {
+        std::vector<quote> q_(q, q + n);
+        std::default_random_engine dre(seed);
+        std::uniform_int_distribution<size_t> k(0, n - 1);
+        std::normal_distribution<double> dr(0, s);
+
+        os.precision(17);
+        for (size_t j = 0; j < m; ++j) {
+            quote& qk = q_[k(dre)];
+            qk.r += dr(dre);
+            os << qk << '\n';
+        }
+    }
+
+    // Stand in for a market feed: call op(line) for each line of a recorded feed
+    // at most rate lines per second, or as fast as possible if rate is 0.
+    template<class Op>
+    inline size_t replay(std::istream& is, Op op, double rate = 0)
+    {
+        std::string line;
+        size_t n = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        while (std::getline(is, line)) {
+            if (rate > 0) {
+                std::this_thread::sleep_until(start + std::chrono::duration<double>(n/rate));
+            }
+            op(line.c_str());
+            ++n;
+        }
+
+        return n;
+    }
+
+} // fms::quote
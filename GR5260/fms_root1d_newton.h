@@ -3,6 +3,7 @@
 #include <cmath>
 #include <functional>
 #include "fms_root1d.h"
+#include "../xll12/xll/ensure.h"
 
 namespace fms::root1d {
 
@@ -13,9 +14,21 @@ namespace fms::root1d {
         const std::function<Y(X)>& f;
         const std::function<Y(X)>& df;
         size_t n;
+        bool bracketed;
+        X a, b; // f(a) and f(b) have opposite signs
+        Y ya;
         newton_solver(X x, const std::function<Y(X)>& f, const std::function<Y(X)>& df)
-            : x(x), f(f), df(df), n(0)
+            : x(x), f(f), df(df), n(0), bracketed(false)
         { }
+        // Steps leaving (a, b) bisect instead so rounding in f can not make x cycle near the root.
+        newton_solver(X x, const std::function<Y(X)>& f, const std::function<Y(X)>& df, X a, X b)
+            : x(x), f(f), df(df), n(0), bracketed(true), a(a), b(b), ya(f(a))
+        {
+            ensure (a < b);
+            ensure (!(x < a) && !(b < x));
+            Y yb = f(b);
+            ensure ((ya < 0) != (yb < 0) || ya == 0 || yb == 0);
+        }
         newton_solver(const newton_solver&) = delete;
         newton_solver& operator=(const newton_solver&) = delete;
         virtual ~newton_solver()
@@ -28,7 +41,15 @@ namespace fms::root1d {
                 return x;
             }
 
-            x = x - y/df(x);
+            if (!bracketed) {
+                x = x - y/df(x);
+
+                return x;
+            }
+
+            ((y < 0) == (ya < 0) ? a : b) = x;
+            X x_ = x - y/df(x);
+            x = (x_ > a && x_ < b) || x_ == x ? x_ : a + (b - a)/2;
 
             return x;
         }
@@ -41,6 +62,9 @@ namespace fms::root1d {
             if (y == 0) {
                 return true;
             }
+            if (bracketed && !(nextafter(a, b) < b)) {
+                return true;
+            }
 
             X x_ = nextafter(x, X(1));
             Y y_ = f(x_);
@@ -61,4 +85,23 @@ namespace fms::root1d {
         }
     };
 
+    // Root of f near x. Number types that record operations, e.g., fms::adjoint::variable,
+    // specialize this so the iterations are not recorded.
+    template<class X>
+    struct newton {
+        static X solve(X x, const std::function<X(X)>& f, const std::function<X(X)>& df)
+        {
+            newton_solver<X,X> solver(x, f, df);
+
+            return solver.solve();
+        }
+        // root in [a, b]
+        static X solve(X x, const std::function<X(X)>& f, const std::function<X(X)>& df, X a, X b)
+        {
+            newton_solver<X,X> solver(x, f, df, a, b);
+
+            return solver.solve();
+        }
+    };
+
 } // fms::root1d
\ No newline at end of file
@@ -0,0 +1,467 @@
+// fms_simd.h - Array kernels using AVX2/AVX-512 when available.
+// Compile with /arch:AVX2 or /arch:AVX512 (-mavx2 or -mavx512f) to enable the vector paths.
+// The templates are the scalar fallback and are used for types other than double.
+#pragma once
+#include <cmath>
+#include <limits>
+#include "fms_prob.h"
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace fms::simd {
+
+    // y[i] += a*x[i]
+    template<class X>
+    inline void axpy(size_t n, const X& a, const X* x, X* y)
+    {
+        for (size_t i = 0; i < n; ++i) {
+            y[i] += a * x[i];
+        }
+    }
+
+    // y[i] = exp(x[i])
+    template<class X>
+    inline void exp(size_t n, const X* x, X* y)
+    {
+        for (size_t i = 0; i < n; ++i) {
+            y[i] = std::exp(x[i]);
+        }
+    }
+
+    // y[i] = log(x[i])
+    template<class X>
+    inline void log(size_t n, const X* x, X* y)
+    {
+        for (size_t i = 0; i < n; ++i) {
+            y[i] = std::log(x[i]);
+        }
+    }
+
+    // y[i] = prob::normal_pdf(x[i])
+    template<class X>
+    inline void normal_pdf(size_t n, const X* x, X* y)
+    {
+        for (size_t i = 0; i < n; ++i) {
+            y[i] = prob::normal_pdf(x[i]);
+        }
+    }
+
+    // y[i] = prob::normal_cdf<X,A>(x[i])
+    template<prob::accuracy A = prob::accuracy::full, class X>
+    inline void normal_cdf(size_t n, const X* x, X* y)
+    {
+        for (size_t i = 0; i < n; ++i) {
+            y[i] = prob::normal_cdf<X,A>(x[i]);
+        }
+    }
+
+    // log(1 + f) = f - f^2/2 + s(f^2/2 + R(s)), s = f/(2 + f), from fdlibm e_log.c
+    constexpr double log_coefficients[] = {
+        6.666666666666735130e-01, 3.999999999940941908e-01, 2.857142874366239149e-01, 2.222219843214978396e-01,
+        1.818357216161805012e-01, 1.531383769920937332e-01, 1.479819860511658591e-01,
+    };
+
+#if defined(__AVX512F__)
+
+    inline void axpy(size_t n, const double& a, const double* x, double* y)
+    {
+        size_t i = 0;
+        __m512d a_ = _mm512_set1_pd(a);
+        for (; i + 8 <= n; i += 8) {
+            __m512d y_ = _mm512_loadu_pd(y + i);
+            y_ = _mm512_add_pd(y_, _mm512_mul_pd(a_, _mm512_loadu_pd(x + i)));
+            _mm512_storeu_pd(y + i, y_);
+        }
+        axpy<double>(n - i, a, x + i, y + i);
+    }
+
+    // 2^k for integral k in [-1022, 1023] using exponent bits
+    inline __m512d pow2(__m512d k)
+    {
+        __m512i e = _mm512_castpd_si512(_mm512_add_pd(k, _mm512_set1_pd(1023 + 4503599627370496.)));
+
+        return _mm512_castsi512_pd(_mm512_slli_epi64(e, 52));
+    }
+
+    // exp(x) = 2^k exp(r) where x = k log 2 + r, |r| <= log(2)/2.
+    inline __m512d exp(__m512d x)
+    {
+        const __m512d hi = _mm512_set1_pd(709.782712893384);
+        const __m512d lo = _mm512_set1_pd(-745.13);
+        __m512d x_ = _mm512_min_pd(_mm512_max_pd(x, lo), hi);
+
+        __m512d k = _mm512_roundscale_pd(_mm512_mul_pd(x_, _mm512_set1_pd(1.4426950408889634)), _MM_FROUND_TO_NEAREST_INT);
+        __m512d r = _mm512_sub_pd(x_, _mm512_mul_pd(k, _mm512_set1_pd(6.93147180369123816490e-01)));
+        r = _mm512_sub_pd(r, _mm512_mul_pd(k, _mm512_set1_pd(1.90821492927058770002e-10)));
+
+        // Taylor series to r^13/13!
+        __m512d p = _mm512_set1_pd(1/6227020800.);
+        const double c[] = { 1/479001600., 1/39916800., 1/3628800., 1/362880., 1/40320., 1/5040., 1/720., 1/120., 1/24., 1/6., 1/2., 1., 1. };
+        for (double ci : c) {
+            p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(ci));
+        }
+
+        // 2^k = 2^k1 2^k2 so subnormal and near overflow results are correct
+        __m512d k1 = _mm512_roundscale_pd(_mm512_mul_pd(k, _mm512_set1_pd(0.5)), _MM_FROUND_TO_NEG_INF);
+        __m512d y = _mm512_mul_pd(_mm512_mul_pd(p, pow2(k1)), pow2(_mm512_sub_pd(k, k1)));
+
+        // underflow, overflow, and NaN
+        y = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, _mm512_set1_pd(-745.13), _CMP_LT_OQ), y, _mm512_setzero_pd());
+        y = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, _mm512_set1_pd(709.782712893384), _CMP_GT_OQ), y, _mm512_set1_pd(HUGE_VAL));
+        y = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, x, _CMP_UNORD_Q), y, x);
+
+        return y;
+    }
+
+    inline void exp(size_t n, const double* x, double* y)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            _mm512_storeu_pd(y + i, exp(_mm512_loadu_pd(x + i)));
+        }
+        exp<double>(n - i, x + i, y + i);
+    }
+
+    // log(x) = k log 2 + log(m), x = 2^k m, sqrt(2)/2 < m < sqrt(2)
+    inline __m512d log(__m512d x)
+    {
+        // scale subnormals
+        __mmask8 tiny = _mm512_cmp_pd_mask(x, _mm512_set1_pd(2.2250738585072014e-308), _CMP_LT_OQ);
+        __m512d x_ = _mm512_mask_mul_pd(x, tiny, x, _mm512_set1_pd(18014398509481984.));
+        __m512d k = _mm512_mask_blend_pd(tiny, _mm512_setzero_pd(), _mm512_set1_pd(-54));
+
+        // exponent and mantissa in [1, 2)
+        __m512i b = _mm512_castpd_si512(x_);
+        __m512i e = _mm512_srli_epi64(b, 52);
+        k = _mm512_add_pd(k, _mm512_sub_pd(_mm512_castsi512_pd(_mm512_or_si512(e, _mm512_set1_epi64(0x4330000000000000))),
+            _mm512_set1_pd(4503599627370496. + 1023)));
+        __m512d m = _mm512_castsi512_pd(_mm512_or_si512(_mm512_and_si512(b, _mm512_set1_epi64(0x000fffffffffffff)),
+            _mm512_set1_epi64(0x3ff0000000000000)));
+        __mmask8 big = _mm512_cmp_pd_mask(m, _mm512_set1_pd(1.4142135623730951), _CMP_GT_OQ);
+        m = _mm512_mask_mul_pd(m, big, m, _mm512_set1_pd(0.5));
+        k = _mm512_mask_add_pd(k, big, k, _mm512_set1_pd(1));
+
+        const double* Lg = log_coefficients;
+        __m512d f = _mm512_sub_pd(m, _mm512_set1_pd(1));
+        __m512d s = _mm512_div_pd(f, _mm512_add_pd(_mm512_set1_pd(2), f));
+        __m512d z = _mm512_mul_pd(s, s);
+        __m512d w = _mm512_mul_pd(z, z);
+        __m512d t1 = _mm512_mul_pd(w, _mm512_add_pd(_mm512_set1_pd(Lg[1]), _mm512_mul_pd(w,
+            _mm512_add_pd(_mm512_set1_pd(Lg[3]), _mm512_mul_pd(w, _mm512_set1_pd(Lg[5]))))));
+        __m512d t2 = _mm512_mul_pd(z, _mm512_add_pd(_mm512_set1_pd(Lg[0]), _mm512_mul_pd(w,
+            _mm512_add_pd(_mm512_set1_pd(Lg[2]), _mm512_mul_pd(w, _mm512_add_pd(_mm512_set1_pd(Lg[4]),
+            _mm512_mul_pd(w, _mm512_set1_pd(Lg[6]))))))));
+        __m512d R = _mm512_add_pd(t2, t1);
+        __m512d hfsq = _mm512_mul_pd(_mm512_set1_pd(0.5), _mm512_mul_pd(f, f));
+
+        // k ln2_hi - ((hfsq - (s (hfsq + R) + k ln2_lo)) - f)
+        __m512d y = _mm512_add_pd(_mm512_mul_pd(s, _mm512_add_pd(hfsq, R)), _mm512_mul_pd(k, _mm512_set1_pd(1.90821492927058770002e-10)));
+        y = _mm512_sub_pd(_mm512_sub_pd(hfsq, y), f);
+        y = _mm512_sub_pd(_mm512_mul_pd(k, _mm512_set1_pd(6.93147180369123816490e-01)), y);
+
+        // zero, negative, infinity, and NaN
+        y = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, _mm512_setzero_pd(), _CMP_EQ_OQ), y, _mm512_set1_pd(-HUGE_VAL));
+        y = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, _mm512_set1_pd(HUGE_VAL), _CMP_EQ_OQ), y, x);
+        y = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, _mm512_setzero_pd(), _CMP_NGE_UQ), y, _mm512_set1_pd(std::numeric_limits<double>::quiet_NaN()));
+
+        return y;
+    }
+
+    inline void log(size_t n, const double* x, double* y)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            _mm512_storeu_pd(y + i, log(_mm512_loadu_pd(x + i)));
+        }
+        log<double>(n - i, x + i, y + i);
+    }
+
+    // exp(-x^2/2)/sqrt(2 pi)
+    inline __m512d normal_pdf(__m512d x)
+    {
+        return _mm512_mul_pd(exp(_mm512_mul_pd(_mm512_mul_pd(x, x), _mm512_set1_pd(-0.5))), _mm512_set1_pd(prob::sqrt1_2pi));
+    }
+
+    inline void normal_pdf(size_t n, const double* x, double* y)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            _mm512_storeu_pd(y + i, normal_pdf(_mm512_loadu_pd(x + i)));
+        }
+        normal_pdf<double>(n - i, x + i, y + i);
+    }
+
+    // Low accuracy uses A&S 26.2.17. Otherwise 1/2 + erf(x/sqrt(2))/2 for |x/sqrt(2)| < 0.9,
+    // and erfc(|x|/sqrt(2))/2 or 1 minus that for larger |x|.
+    template<prob::accuracy A = prob::accuracy::full>
+    inline __m512d normal_cdf(__m512d x)
+    {
+        if constexpr (A == prob::accuracy::low) {
+            const double* b = prob::as_coefficients;
+            __m512d t = _mm512_div_pd(_mm512_set1_pd(1), _mm512_add_pd(_mm512_set1_pd(1), _mm512_mul_pd(_mm512_set1_pd(prob::as_p), _mm512_abs_pd(x))));
+            __m512d p = _mm512_set1_pd(b[4]);
+            for (size_t i = 4; i-- > 0; ) {
+                p = _mm512_add_pd(_mm512_mul_pd(p, t), _mm512_set1_pd(b[i]));
+            }
+            __m512d q = _mm512_mul_pd(normal_pdf(x), _mm512_mul_pd(t, p));
+
+            return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, _mm512_setzero_pd(), _CMP_LT_OQ), _mm512_sub_pd(_mm512_set1_pd(1), q), q);
+        }
+        else {
+            __m512d y = _mm512_div_pd(x, _mm512_set1_pd(prob::sqrt2));
+            __m512d z = _mm512_mul_pd(y, y);
+            __m512d ay = _mm512_abs_pd(y);
+            __mmask8 m = _mm512_cmp_pd_mask(ay, _mm512_set1_pd(0.9), _CMP_LT_OQ);
+
+            const double* a = prob::erf_coefficients;
+            constexpr size_t na = prob::erf_terms<A>;
+            __m512d p = _mm512_set1_pd(a[na - 1]);
+            for (size_t i = na - 1; i-- > 0; ) {
+                p = _mm512_add_pd(_mm512_mul_pd(p, z), _mm512_set1_pd(a[i]));
+            }
+            __m512d small = _mm512_add_pd(_mm512_set1_pd(0.5), _mm512_mul_pd(_mm512_mul_pd(y, p), _mm512_set1_pd(0.5)));
+            if (m == 0xFF) {
+                return small;
+            }
+
+            // Clenshaw recurrence, erfc(y) is 0 to machine precision for y > 40
+            const double* c = prob::erfcx_coefficients;
+            constexpr size_t nc = prob::erfcx_terms<A>;
+            __m512d y_ = _mm512_min_pd(_mm512_set1_pd(40), ay);
+            __m512d s = _mm512_div_pd(_mm512_sub_pd(y_, _mm512_set1_pd(3.8)), _mm512_add_pd(y_, _mm512_set1_pd(2)));
+            __m512d s2 = _mm512_add_pd(s, s);
+            __m512d b1 = _mm512_setzero_pd(), b2 = _mm512_setzero_pd();
+            for (size_t i = nc - 1; i > 0; --i) {
+                __m512d b = _mm512_add_pd(_mm512_sub_pd(_mm512_mul_pd(s2, b1), b2), _mm512_set1_pd(c[i]));
+                b2 = b1;
+                b1 = b;
+            }
+            __m512d g = _mm512_add_pd(_mm512_sub_pd(_mm512_mul_pd(s, b1), b2), _mm512_set1_pd(c[0]));
+            __m512d h = _mm512_mul_pd(_mm512_set1_pd(0.5), _mm512_mul_pd(g, exp(_mm512_sub_pd(_mm512_setzero_pd(), z))));
+            __m512d large = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(y, _mm512_setzero_pd(), _CMP_LT_OQ), _mm512_sub_pd(_mm512_set1_pd(1), h), h);
+
+            return _mm512_mask_blend_pd(m, large, small);
+        }
+    }
+
+    template<prob::accuracy A = prob::accuracy::full>
+    inline void normal_cdf(size_t n, const double* x, double* y)
+    {
+        size_t i = 0;
+        // two independent recurrences hide latency
+        for (; i + 16 <= n; i += 16) {
+            __m512d y0 = normal_cdf<A>(_mm512_loadu_pd(x + i));
+            __m512d y1 = normal_cdf<A>(_mm512_loadu_pd(x + i + 8));
+            _mm512_storeu_pd(y + i, y0);
+            _mm512_storeu_pd(y + i + 8, y1);
+        }
+        for (; i + 8 <= n; i += 8) {
+            _mm512_storeu_pd(y + i, normal_cdf<A>(_mm512_loadu_pd(x + i)));
+        }
+        normal_cdf<A,double>(n - i, x + i, y + i);
+    }
+
+#elif defined(__AVX2__)
+
+    inline void axpy(size_t n, const double& a, const double* x, double* y)
+    {
+        size_t i = 0;
+        __m256d a_ = _mm256_set1_pd(a);
+        for (; i + 4 <= n; i += 4) {
+            __m256d y_ = _mm256_loadu_pd(y + i);
+            y_ = _mm256_add_pd(y_, _mm256_mul_pd(a_, _mm256_loadu_pd(x + i)));
+            _mm256_storeu_pd(y + i, y_);
+        }
+        axpy<double>(n - i, a, x + i, y + i);
+    }
+
+    // 2^k for integral k in [-1022, 1023] using exponent bits
+    inline __m256d pow2(__m256d k)
+    {
+        __m256i e = _mm256_castpd_si256(_mm256_add_pd(k, _mm256_set1_pd(1023 + 4503599627370496.)));
+
+        return _mm256_castsi256_pd(_mm256_slli_epi64(e, 52));
+    }
+
+    // exp(x) = 2^k exp(r) where x = k log 2 + r, |r| <= log(2)/2.
+    inline __m256d exp(__m256d x)
+    {
+        const __m256d hi = _mm256_set1_pd(709.782712893384);
+        const __m256d lo = _mm256_set1_pd(-745.13);
+        __m256d x_ = _mm256_min_pd(_mm256_max_pd(x, lo), hi);
+
+        __m256d k = _mm256_round_pd(_mm256_mul_pd(x_, _mm256_set1_pd(1.4426950408889634)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256d r = _mm256_sub_pd(x_, _mm256_mul_pd(k, _mm256_set1_pd(6.93147180369123816490e-01)));
+        r = _mm256_sub_pd(r, _mm256_mul_pd(k, _mm256_set1_pd(1.90821492927058770002e-10)));
+
+        // Taylor series to r^13/13!
+        __m256d p = _mm256_set1_pd(1/6227020800.);
+        const double c[] = { 1/479001600., 1/39916800., 1/3628800., 1/362880., 1/40320., 1/5040., 1/720., 1/120., 1/24., 1/6., 1/2., 1., 1. };
+        for (double ci : c) {
+            p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(ci));
+        }
+
+        // 2^k = 2^k1 2^k2 so subnormal and near overflow results are correct
+        __m256d k1 = _mm256_floor_pd(_mm256_mul_pd(k, _mm256_set1_pd(0.5)));
+        __m256d y = _mm256_mul_pd(_mm256_mul_pd(p, pow2(k1)), pow2(_mm256_sub_pd(k, k1)));
+
+        // underflow, overflow, and NaN
+        y = _mm256_blendv_pd(y, _mm256_setzero_pd(), _mm256_cmp_pd(x, _mm256_set1_pd(-745.13), _CMP_LT_OQ));
+        y = _mm256_blendv_pd(y, _mm256_set1_pd(HUGE_VAL), _mm256_cmp_pd(x, _mm256_set1_pd(709.782712893384), _CMP_GT_OQ));
+        y = _mm256_blendv_pd(y, x, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+
+        return y;
+    }
+
+    inline void exp(size_t n, const double* x, double* y)
+    {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            _mm256_storeu_pd(y + i, exp(_mm256_loadu_pd(x + i)));
+        }
+        exp<double>(n - i, x + i, y + i);
+    }
+
+    // log(x) = k log 2 + log(m), x = 2^k m, sqrt(2)/2 < m < sqrt(2)
+    inline __m256d log(__m256d x)
+    {
+        // scale subnormals
+        __m256d tiny = _mm256_cmp_pd(x, _mm256_set1_pd(2.2250738585072014e-308), _CMP_LT_OQ);
+        __m256d x_ = _mm256_blendv_pd(x, _mm256_mul_pd(x, _mm256_set1_pd(18014398509481984.)), tiny);
+        __m256d k = _mm256_blendv_pd(_mm256_setzero_pd(), _mm256_set1_pd(-54), tiny);
+
+        // exponent and mantissa in [1, 2)
+        __m256i b = _mm256_castpd_si256(x_);
+        __m256i e = _mm256_srli_epi64(b, 52);
+        k = _mm256_add_pd(k, _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(e, _mm256_set1_epi64x(0x4330000000000000))),
+            _mm256_set1_pd(4503599627370496. + 1023)));
+        __m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(b, _mm256_set1_epi64x(0x000fffffffffffff)),
+            _mm256_set1_epi64x(0x3ff0000000000000)));
+        __m256d big = _mm256_cmp_pd(m, _mm256_set1_pd(1.4142135623730951), _CMP_GT_OQ);
+        m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), big);
+        k = _mm256_add_pd(k, _mm256_and_pd(big, _mm256_set1_pd(1)));
+
+        const double* Lg = log_coefficients;
+        __m256d f = _mm256_sub_pd(m, _mm256_set1_pd(1));
+        __m256d s = _mm256_div_pd(f, _mm256_add_pd(_mm256_set1_pd(2), f));
+        __m256d z = _mm256_mul_pd(s, s);
+        __m256d w = _mm256_mul_pd(z, z);
+        __m256d t1 = _mm256_mul_pd(w, _mm256_add_pd(_mm256_set1_pd(Lg[1]), _mm256_mul_pd(w,
+            _mm256_add_pd(_mm256_set1_pd(Lg[3]), _mm256_mul_pd(w, _mm256_set1_pd(Lg[5]))))));
+        __m256d t2 = _mm256_mul_pd(z, _mm256_add_pd(_mm256_set1_pd(Lg[0]), _mm256_mul_pd(w,
+            _mm256_add_pd(_mm256_set1_pd(Lg[2]), _mm256_mul_pd(w, _mm256_add_pd(_mm256_set1_pd(Lg[4]),
+            _mm256_mul_pd(w, _mm256_set1_pd(Lg[6]))))))));
+        __m256d R = _mm256_add_pd(t2, t1);
+        __m256d hfsq = _mm256_mul_pd(_mm256_set1_pd(0.5), _mm256_mul_pd(f, f));
+
+        // k ln2_hi - ((hfsq - (s (hfsq + R) + k ln2_lo)) - f)
+        __m256d y = _mm256_add_pd(_mm256_mul_pd(s, _mm256_add_pd(hfsq, R)), _mm256_mul_pd(k, _mm256_set1_pd(1.90821492927058770002e-10)));
+        y = _mm256_sub_pd(_mm256_sub_pd(hfsq, y), f);
+        y = _mm256_sub_pd(_mm256_mul_pd(k, _mm256_set1_pd(6.93147180369123816490e-01)), y);
+
+        // zero, negative, infinity, and NaN
+        y = _mm256_blendv_pd(y, _mm256_set1_pd(-HUGE_VAL), _mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_EQ_OQ));
+        y = _mm256_blendv_pd(y, x, _mm256_cmp_pd(x, _mm256_set1_pd(HUGE_VAL), _CMP_EQ_OQ));
+        y = _mm256_blendv_pd(y, _mm256_set1_pd(std::numeric_limits<double>::quiet_NaN()), _mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_NGE_UQ));
+
+        return y;
+    }
+
+    inline void log(size_t n, const double* x, double* y)
+    {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            _mm256_storeu_pd(y + i, log(_mm256_loadu_pd(x + i)));
+        }
+        log<double>(n - i, x + i, y + i);
+    }
+
+    // exp(-x^2/2)/sqrt(2 pi)
+    inline __m256d normal_pdf(__m256d x)
+    {
+        return _mm256_mul_pd(exp(_mm256_mul_pd(_mm256_mul_pd(x, x), _mm256_set1_pd(-0.5))), _mm256_set1_pd(prob::sqrt1_2pi));
+    }
+
+    inline void normal_pdf(size_t n, const double* x, double* y)
+    {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            _mm256_storeu_pd(y + i, normal_pdf(_mm256_loadu_pd(x + i)));
+        }
+        normal_pdf<double>(n - i, x + i, y + i);
+    }
+
+    // Low accuracy uses A&S 26.2.17. Otherwise 1/2 + erf(x/sqrt(2))/2 for |x/sqrt(2)| < 0.9,
+    // and erfc(|x|/sqrt(2))/2 or 1 minus that for larger |x|.
+    template<prob::accuracy A = prob::accuracy::full>
+    inline __m256d normal_cdf(__m256d x)
+    {
+        if constexpr (A == prob::accuracy::low) {
+            const double* b = prob::as_coefficients;
+            __m256d t = _mm256_div_pd(_mm256_set1_pd(1), _mm256_add_pd(_mm256_set1_pd(1), _mm256_mul_pd(_mm256_set1_pd(prob::as_p), _mm256_andnot_pd(_mm256_set1_pd(-0.), x))));
+            __m256d p = _mm256_set1_pd(b[4]);
+            for (size_t i = 4; i-- > 0; ) {
+                p = _mm256_add_pd(_mm256_mul_pd(p, t), _mm256_set1_pd(b[i]));
+            }
+            __m256d q = _mm256_mul_pd(normal_pdf(x), _mm256_mul_pd(t, p));
+
+            return _mm256_blendv_pd(_mm256_sub_pd(_mm256_set1_pd(1), q), q, x);
+        }
+        else {
+            __m256d y = _mm256_div_pd(x, _mm256_set1_pd(prob::sqrt2));
+            __m256d z = _mm256_mul_pd(y, y);
+            __m256d ay = _mm256_andnot_pd(_mm256_set1_pd(-0.), y);
+            __m256d m = _mm256_cmp_pd(ay, _mm256_set1_pd(0.9), _CMP_LT_OQ);
+
+            const double* a = prob::erf_coefficients;
+            constexpr size_t na = prob::erf_terms<A>;
+            __m256d p = _mm256_set1_pd(a[na - 1]);
+            for (size_t i = na - 1; i-- > 0; ) {
+                p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(a[i]));
+            }
+            __m256d small = _mm256_add_pd(_mm256_set1_pd(0.5), _mm256_mul_pd(_mm256_mul_pd(y, p), _mm256_set1_pd(0.5)));
+            if (_mm256_movemask_pd(m) == 0xF) {
+                return small;
+            }
+
+            // Clenshaw recurrence, erfc(y) is 0 to machine precision for y > 40
+            const double* c = prob::erfcx_coefficients;
+            constexpr size_t nc = prob::erfcx_terms<A>;
+            __m256d y_ = _mm256_min_pd(_mm256_set1_pd(40), ay);
+            __m256d s = _mm256_div_pd(_mm256_sub_pd(y_, _mm256_set1_pd(3.8)), _mm256_add_pd(y_, _mm256_set1_pd(2)));
+            __m256d s2 = _mm256_add_pd(s, s);
+            __m256d b1 = _mm256_setzero_pd(), b2 = _mm256_setzero_pd();
+            for (size_t i = nc - 1; i > 0; --i) {
+                __m256d b = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(s2, b1), b2), _mm256_set1_pd(c[i]));
+                b2 = b1;
+                b1 = b;
+            }
+            __m256d g = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(s, b1), b2), _mm256_set1_pd(c[0]));
+            __m256d h = _mm256_mul_pd(_mm256_set1_pd(0.5), _mm256_mul_pd(g, exp(_mm256_sub_pd(_mm256_setzero_pd(), z))));
+            __m256d large = _mm256_blendv_pd(_mm256_sub_pd(_mm256_set1_pd(1), h), h, y);
+
+            return _mm256_blendv_pd(large, small, m);
+        }
+    }
+
+    template<prob::accuracy A = prob::accuracy::full>
+    inline void normal_cdf(size_t n, const double* x, double* y)
+    {
+        size_t i = 0;
+        // two independent recurrences hide latency
+        for (; i + 8 <= n; i += 8) {
+            __m256d y0 = normal_cdf<A>(_mm256_loadu_pd(x + i));
+            __m256d y1 = normal_cdf<A>(_mm256_loadu_pd(x + i + 4));
+            _mm256_storeu_pd(y + i, y0);
+            _mm256_storeu_pd(y + i + 4, y1);
+        }
+        for (; i + 4 <= n; i += 4) {
+            _mm256_storeu_pd(y + i, normal_cdf<A>(_mm256_loadu_pd(x + i)));
+        }
+        normal_cdf<A,double>(n - i, x + i, y + i);
+    }
+
+#endif
+
+} // fms::simd
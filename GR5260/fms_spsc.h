@@ -0,0 +1,62 @@
+// fms_spsc.h - lock free single producer single consumer ring buffer
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+namespace fms {
+
+    // Fixed capacity N, a power of 2. One thread may push and one other thread may pop.
+    template<class X, size_t N = 1024>
+    class spsc {
+        static_assert(N > 0 && (N & (N - 1)) == 0, "capacity must be a power of 2");
+
+        alignas(64) std::atomic<size_t> head; // next to pop, written by consumer
+        alignas(64) std::atomic<size_t> tail; // next to push, written by producer
+        alignas(64) X x[N];
+    public:
+        spsc()
+            : head(0), tail(0)
+        { }
+        spsc(const spsc&) = delete;
+        spsc& operator=(const spsc&) = delete;
+
+        static constexpr size_t capacity() { return N; }
+
+        // false if full
+        bool push(const X& x_)
+        {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) == N) {
+                return false;
+            }
+            x[t & (N - 1)] = x_;
+            tail.store(t + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        // false if empty
+        bool pop(X& x_)
+        {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire)) {
+                return false;
+            }
+            x_ = x[h & (N - 1)];
+            head.store(h + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        // approximate when called concurrently
+        size_t size() const
+        {
+            return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+        }
+        bool empty() const
+        {
+            return size() == 0;
+        }
+    };
+
+} // fms